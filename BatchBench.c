@@ -0,0 +1,175 @@
+/**************************************************************
+* FILENAME:		BatchBench.c
+*
+* DESCRIPTION:	Renders first-person views for a crowd of simulated
+*				agents with RenderCameraBatch(), without a window,
+*				and reports how many frames per second that gives.
+*
+* NOTES:		"make batchbench" builds and runs it:
+*					./batchbench [-map file.p3dm] [-agents N]
+*						[-w W] [-h H] [-batches N] [-threads N]
+*						[-simd off|sse2|avx2] [-grid cells|morton]
+*						[-textures off] [-floors off] [-out file.ppm]
+*				Agents start in random open cells (fixed seed) and
+*				between batches each one walks a step and turns a
+*				little at random, sliding along walls like the
+*				player. Only RenderCameraBatch() is timed; the first
+*				BATCH_WARMUP batches are left out. -out writes the
+*				last batch as one PPM image, the frames side by
+*				side in rows.
+*				Like MicroBench.c it only links SDL for its types
+*				and the performance counter.
+**************************************************************/
+#include "SDL2/SDL.h"
+#include <stdio.h>
+#include <math.h>
+#include "pthread.h"
+#include "const.h"
+#include "map1.h"
+#include "MapLoader.h"
+#include "SDL_Helpers.h"
+#include "Framebuffer.h"
+#include "RayKernel.h"
+#include "Textures.h"
+#include "Palette.h"
+#include "Bench.h"
+#include "Movement.h"
+#include "Floors.h"
+#include "WorkerPool.h"
+#include "BatchRender.h"
+
+#define BATCH_AGENTS		256
+#define BATCH_WIDTH			84
+#define BATCH_HEIGHT		84
+#define BATCH_BATCHES		200
+#define BATCH_WARMUP		5
+#define BATCH_SEED			1
+#define BATCH_STEP			0.05	// cells an agent walks per batch
+
+/* xorshift32, like GenerateMap() */
+HIDDEN double BatchRandom(uint32_t *state){
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+	return *state / 4294967296.0;
+}
+
+/* Write count frames as one PPM image, frames side by side in rows of up to sqrt(count) */
+HIDDEN bool WriteBatchImage(const char *path, const Uint32 *pixels, int count, int width, int height){
+	FILE *out = fopen(path, "wb");
+	if (out == NULL){
+		printf("%s%s\n", "Could not write ", path);
+		return FALSE;
+	}
+	int across = (int)ceil(sqrt((double)count));
+	int down = (count + across - 1) / across;
+	fprintf(out, "P6\n%i %i\n255\n", across * width, down * height);
+	for (int y = 0; y < down * height; y++){
+		for (int x = 0; x < across * width; x++){
+			int frame = y / height * across + x / width;
+			Uint32 color = frame < count ? pixels[((size_t)frame * height + y % height) * width + x % width] : 0;
+			unsigned char rgb[3] = {(color >> 16) & 0xFF, (color >> 8) & 0xFF, color & 0xFF};
+			fwrite(rgb, 1, 3, out);
+		}
+	}
+	fclose(out);
+	return TRUE;
+}
+
+int main(int argc, char *argv[]){
+	char *mapPath = NULL;
+	char *outPath = NULL;
+	int agents = BATCH_AGENTS;
+	int width = BATCH_WIDTH;
+	int height = BATCH_HEIGHT;
+	int batches = BATCH_BATCHES;
+
+	/* Argument Variables */
+	for (int i = 1; i < argc; i++){
+		if (!strcmp(argv[i], "-map") && (i+1) < argc) mapPath = argv[i+1];
+		else if (!strcmp(argv[i], "-out") && (i+1) < argc) outPath = argv[i+1];
+		else if (!strcmp(argv[i], "-agents") && (i+1) < argc) agents = atoi(argv[i+1]);
+		else if (!strcmp(argv[i], "-w") && (i+1) < argc) width = atoi(argv[i+1]);
+		else if (!strcmp(argv[i], "-h") && (i+1) < argc) height = atoi(argv[i+1]);
+		else if (!strcmp(argv[i], "-batches") && (i+1) < argc) batches = atoi(argv[i+1]);
+		else if (!strcmp(argv[i], "-threads") && (i+1) < argc) threadCount = atoi(argv[i+1]);
+		else if (!strcmp(argv[i], "-simd") && (i+1) < argc){
+			if (!strcmp(argv[i+1], "off")) rayKernel = KERNEL_SCALAR;
+			else if (!strcmp(argv[i+1], "sse2")) rayKernel = KERNEL_SSE2;
+			else if (!strcmp(argv[i+1], "avx2")) rayKernel = KERNEL_AVX2;
+		}
+		else if (!strcmp(argv[i], "-grid") && (i+1) < argc){
+			if (!strcmp(argv[i+1], "morton")) rayGrid = GRID_MORTON;
+		}
+		else if (!strcmp(argv[i], "-textures") && (i+1) < argc){
+			if (!strcmp(argv[i+1], "off")) texturesEnabled = FALSE;
+		}
+		else if (!strcmp(argv[i], "-floors") && (i+1) < argc){
+			if (!strcmp(argv[i+1], "off")) floorsEnabled = FALSE;
+		}
+	}
+	if (agents < 1 || width < 2 || height < 1 || batches <= BATCH_WARMUP){
+		printf("%s%i%s\n", "Need at least one agent, frames 2x1 pixels or larger and more than ", BATCH_WARMUP, " batches");
+		return EXIT_FAILURE;
+	}
+
+	/* The world, and everything every frame shares */
+	if (mapPath != NULL && !LoadMapFile(mapPath)) return EXIT_FAILURE;
+	if (mapPath == NULL && !LoadCompiledMap(&worldMap[0][0], WORLD_HEIGHT, WORLD_WIDTH)) return EXIT_FAILURE;
+	if (texturesEnabled && !GenerateTextures()) printf("%s\n", "Out of memory for textures, drawing flat walls");
+	if (floorsEnabled && !CreateFloors()){
+		printf("%s\n", "Out of memory for floors, drawing a black background");
+		floorsEnabled = FALSE;
+	}
+	InitRayPrecision();
+	rayKernel = SelectRayKernel(rayKernel);
+	rayGrid = SelectRayGrid(rayGrid == GRID_MORTON ? GRID_MORTON : GRID_CELLS);
+	CreateWorkerPool(threadCount);
+
+	CameraState *cameras = malloc(sizeof(CameraState) * agents);
+	double *turns = malloc(sizeof(double) * agents);
+	Uint32 *pixels = malloc(sizeof(Uint32) * width * height * (size_t)agents);
+	if (cameras == NULL || turns == NULL || pixels == NULL){
+		printf("%s\n", "Out of memory for the frames");
+		return EXIT_FAILURE;
+	}
+	uint32_t random = BATCH_SEED;
+	for (int agent = 0; agent < agents; agent++){
+		double x, y;
+		do{
+			x = 1 + BatchRandom(&random) * (world.sizeX - 2);
+			y = 1 + BatchRandom(&random) * (world.sizeY - 2);
+		} while (WORLD_CELL((int)x, (int)y) != EMPTYSPACE);
+		double angle = BatchRandom(&random) * 2 * M_PI;
+		cameras[agent] = (CameraState){x, y, cos(angle), sin(angle), -0.66 * sin(angle), 0.66 * cos(angle)};
+		turns[agent] = (BatchRandom(&random) - 0.5) * 0.2;
+	}
+	printf("%s%i%s%ix%i%s%i%s%s%s%s\n", "Agents: ", agents, ", ", width, height, " frames, ", threadCount, " threads, ",
+		rayKernelNames[rayKernel], "/", rayGridNames[rayGrid]);
+
+	/* Render, then let every agent walk and turn */
+	double elapsed = 0;
+	for (int batch = 0; batch < batches; batch++){
+		Uint64 start = SDL_GetPerformanceCounter();
+		RenderCameraBatch(cameras, agents, width, height, pixels);
+		if (batch >= BATCH_WARMUP) elapsed += ElapsedMs(start, SDL_GetPerformanceCounter());
+		for (int agent = 0; agent < agents; agent++){
+			CameraState *camera = &cameras[agent];
+			MovePlayer(camera, camera->posX + camera->dirX * BATCH_STEP, camera->posY + camera->dirY * BATCH_STEP);
+			TurnPlayer(camera, turns[agent]);
+		}
+	}
+	double frames = (double)(batches - BATCH_WARMUP) * agents;
+	printf("%s%.0f%s%.3f%s%.0f%s%.2f%s\n", "Rendered ", frames, " frames in ", elapsed, " ms: ",
+		frames * 1000 / elapsed, " frames/s, ", elapsed * 1000 / frames, " us per frame");
+	if (outPath != NULL) WriteBatchImage(outPath, pixels, agents, width, height);
+
+	DestroyWorkerPool();
+	DestroyFloors();
+	FreeTextures();
+	FreeWorldMap();
+	free(cameras);
+	free(turns);
+	free(pixels);
+	return EXIT_SUCCESS;
+}
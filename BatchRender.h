@@ -0,0 +1,122 @@
+/**************************************************************
+* FILENAME:		BatchRender.h
+*
+* DESCRIPTION:	Renders many cameras at once into caller-provided
+*				framebuffers, without a window: first-person views
+*				for simulated agents.
+*
+* NOTES:		RenderCameraBatch() takes an array of camera states
+*				and fills one contiguous block of frames, frame i at
+*				pixels + i * width * height, each row-major ARGB8888
+*				like frameBuffer. Frames are independent, so each one
+*				is a ParallelFor() tile: a thread casts its rays in
+*				one CastRays() call (whole packets with the selected
+*				kernel and grid) and draws it straight away, while
+*				its pixels are still in cache. Every thread reads the
+*				same world, occupancy plane, distance field, wall and
+*				floor textures; nothing is copied per frame and the
+*				renderer's own globals (frameBuffer, SCREEN_WIDTH,
+*				the view cache) are left alone, so a batch may run
+*				between two frames of the window.
+*				Frames look like the window's at the same size:
+*				textured walls when an atlas is loaded, floors and
+*				ceilings when CreateFloors() has run and floorsEnabled
+*				is set, black around the walls otherwise. Sprites and
+*				dynamic resolution are left out. A camera outside the
+*				map's border walls (or at NaN) gets a black frame.
+*				BatchBench.c ("make batchbench") times it.
+**************************************************************/
+
+// A batch being rendered
+typedef struct {
+	const CameraState *cameras;
+	int width;
+	int height;
+	Uint32 *pixels;
+	bool floors;
+} CameraBatch;
+
+/* ---- RenderBatchFrame() ---------------------------------------
+* Parameters: 	frame - index of a camera in the batch, data - the
+*				CameraBatch
+* Type: 		Public
+* Return:		None
+* Description:
+*	Renders one camera of a batch: floor rows first, then every
+*	column's wall slice over them, the same way RenderFrame() and
+*	DrawColumn() do for the window. Ray directions and hits live
+*	on this thread's stack. A camera that is not strictly inside
+*	the border walls (InsideMap()) would walk off the grid, so its
+*	frame is filled black instead.
+* --------------------------------- end RenderBatchFrame() ---- */
+HIDDEN void RenderBatchFrame(int frame, void *data){
+	const CameraBatch *batch = data;
+	const CameraState *camera = &batch->cameras[frame];
+	int width = batch->width;
+	int height = batch->height;
+	if (width < 2 || height < 1) return; // a column's camera space position divides by width - 1
+	Uint32 *pixels = batch->pixels + (size_t)frame * width * height;
+	if (!InsideMap(camera->posX, camera->posY)){
+		for (size_t i = 0; i < (size_t)width * height; i++) pixels[i] = COLOR_BLACK;
+		return;
+	}
+	double rayDirX[width];
+	double rayDirY[width];
+	ColumnHit hits[width];
+	double columnStep = 2 / ((double)(width) - 1);
+
+	for (int x = 0; x < width; x++){
+		double cameraX = 2 * x / ((double)(width) - 1); // x-coordinate in camera space
+		rayDirX[x] = camera->dirX + camera->planeX * cameraX;
+		rayDirY[x] = camera->dirY + camera->planeY * cameraX;
+	}
+	CastRays(camera->posX, camera->posY, rayDirX, rayDirY, width, hits);
+
+	if (batch->floors){
+		int horizon = height / 2;
+		for (int k = 0; k < height - horizon; k++){
+			int ceilingRow = horizon - 1 - k;
+			FloorRows(pixels + (size_t)(horizon + k) * width, ceilingRow >= 0 ? pixels + (size_t)ceilingRow * width : NULL,
+				width, 0.5 * height / (k + 0.5), camera, columnStep);
+		}
+	}
+	for (int x = 0; x < width; x++){
+		const ColumnHit *hit = &hits[x];
+		int cell = WORLD_CELL(hit->mapX, hit->mapY);
+		int drawStart, drawEnd;
+		int lineHeight = WallSliceRows(height, hit->perpWallDist, &drawStart, &drawEnd);
+		if (textureAtlas != NULL){
+			int texture = (cell - 1) % textureCount;
+			if (texture < 0) texture += textureCount;
+			int texX = TextureX(camera->posX, camera->posY, rayDirX[x], rayDirY[x], hit);
+			TextureStripColumn(pixels + x, width, height, drawStart, drawEnd, lineHeight, TextureStrip(texture, hit->side, texX), !batch->floors);
+		}
+		else{
+			FillStrip(pixels + x, width, height, drawStart, drawEnd, WallColor(WallColorNumber(cell) + hit->side * 0.5), !batch->floors);
+		}
+	}
+}
+
+/* ---- RenderCameraBatch() ---------------------------------------
+* Parameters: 	count cameras, size of every frame (at least 2
+*				pixels wide), pixels - room for count frames
+* Type: 		Public
+* Return:		None
+* Description:
+*	Renders every camera into its own frame over the worker pool
+*	and returns once all of them are done. Frames narrower than 2
+*	pixels are left untouched. A camera whose position is not in
+*	[1, sizeX - 1) x [1, sizeY - 1), i.e. inside the border walls,
+*	gets an all black frame rather than being cast. Cameras may use any length of
+*	direction and plane; the fixed point kernel scales long rays
+*	down before converting them. The ray kernel and grid
+*	must already be chosen (SelectRayKernel(), SelectRayGrid()).
+*	Called while another thread owns the pool, the batch runs on
+*	the calling thread instead (see ParallelFor()). Queued map
+*	edits are not applied here: call ApplyMapEdits() (MapEdit.h)
+*	between batches.
+* --------------------------------- end RenderCameraBatch() ---- */
+void RenderCameraBatch(const CameraState *cameras, int count, int width, int height, Uint32 *pixels){
+	CameraBatch batch = {cameras, width, height, pixels, floorsEnabled && rowDistance != NULL};
+	ParallelFor(count, RenderBatchFrame, &batch);
+}
@@ -0,0 +1,214 @@
+/**************************************************************
+* FILENAME:		Bench.h
+*
+* DESCRIPTION:	Headless, repeatable benchmark mode.
+*
+* NOTES:		-bench <file> replays a camera path (one state per
+*				line: posX posY dirX dirY planeX planeY) instead of
+*				reading the keyboard, times every frame by stage and
+*				prints a summary as JSON (or appends it to a CSV file
+*				with -benchout results.csv, one row per run).
+*				-recordpath <file> writes the same format while
+*				playing normally, so any session can be replayed.
+**************************************************************/
+
+// Camera state as stored in path files (the first six positionInfo values)
+typedef struct {
+	double posX;
+	double posY;
+	double dirX;
+	double dirY;
+	double planeX;
+	double planeY;
+} CameraState;
+
+// Time spent in each stage of one frame, in milliseconds
+typedef struct {
+	double total;	// sum of the stages (not the frame rate limiter's wait)
+	double input;	// polling events and taking the latest camera (0 when replaying a path)
+	double cast;	// DDA for every column
+	double draw;	// turning hits into pixels
+	double overlay;	// profiler overlay or terminal frame time
+	double present;	// upload and SDL_RenderPresent
+	double steps;	// mean cells each ray looked at (not a time)
+	double cached;	// share of columns taken from the view cache instead of cast (not a time)
+	double scale;	// resolution rendered at, as a share of the window's (not a time)
+} FrameTiming;
+
+// Benchmark globals
+char *benchPathFile = NULL;		// set by -bench, NULL when playing normally
+char *benchOutFile = NULL;		// set by -benchout, stdout otherwise
+int benchFrames = 0;			// 0 = play the path once
+FILE *recordPath = NULL;		// set by -recordpath
+CameraState *benchPath = NULL;
+int benchPathLength = 0;
+FrameTiming frameTiming;		// stages of the last frame RayCast() rendered
+FrameTiming *benchTimings = NULL;
+
+#define BENCH_WARMUP		10	// frames left out of the statistics
+
+// Columns of -benchout CSV files; a file started with other columns is not appended to
+const char benchCsvHeader[] = "path,map,frames,width,height,threads,kernel,grid,precision,fixed_size,min_ms,mean_ms,p50_ms,p95_ms,p99_ms,cast_ms,draw_ms,present_ms,rays_per_sec,steps_per_ray,cached_pct,mean_scale,sprites,edits\n";
+
+double ElapsedMs(Uint64 start, Uint64 end){
+	return (double)(end - start) * 1000.0 / (double)SDL_GetPerformanceFrequency();
+}
+
+/* Read a camera path for the loaded map: blank lines and lines starting with # are skipped, and every position must be in an open cell inside the outer wall */
+bool LoadCameraPath(const char *file){
+	FILE *path = fopen(file, "r");
+	char line[256];
+	int capacity = 256;
+	int lineNumber = 0;
+
+	if (path == NULL){
+		printf("%s%s\n", "Could not open camera path ", file);
+		return FALSE;
+	}
+	benchPath = malloc(sizeof(CameraState) * capacity);
+	benchPathLength = 0;
+	while (fgets(line, sizeof(line), path) != NULL){
+		CameraState state;
+		lineNumber++;
+		if (line[0] == '#') continue;
+		if (sscanf(line, "%lf %lf %lf %lf %lf %lf", &state.posX, &state.posY, &state.dirX, &state.dirY, &state.planeX, &state.planeY) != 6) continue;
+		if (!InsideMap(state.posX, state.posY) || WORLD_CELL((int)state.posX, (int)state.posY) != 0){
+			printf("%s%s%s%i%s%ix%i%s\n", "Camera path ", file, " line ", lineNumber, " is outside this ", world.sizeX, world.sizeY,
+				" map or inside a wall");
+			fclose(path);
+			free(benchPath);
+			benchPath = NULL;
+			benchPathLength = 0;
+			return FALSE;
+		}
+		if (benchPathLength == capacity){
+			capacity *= 2;
+			benchPath = realloc(benchPath, sizeof(CameraState) * capacity);
+		}
+		benchPath[benchPathLength++] = state;
+	}
+	fclose(path);
+
+	if (benchPathLength == 0){
+		printf("%s%s\n", "No camera states in ", file);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/* Copy a path state into positionInfo */
+void ApplyCameraState(const CameraState *state, double *positionInfo){
+	positionInfo[0] = state->posX;
+	positionInfo[1] = state->posY;
+	positionInfo[2] = state->dirX;
+	positionInfo[3] = state->dirY;
+	positionInfo[4] = state->planeX;
+	positionInfo[5] = state->planeY;
+}
+
+/* Append positionInfo to a path being recorded */
+void RecordCameraState(FILE *path, const double *positionInfo){
+	fprintf(path, "%.17g %.17g %.17g %.17g %.17g %.17g\n", positionInfo[0], positionInfo[1], positionInfo[2], positionInfo[3], positionInfo[4], positionInfo[5]);
+}
+
+HIDDEN int CompareDouble(const void *a, const void *b){
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+/* Nearest-rank percentile of an ascending array */
+HIDDEN double Percentile(const double *sorted, int count, double percent){
+	int rank = (int)ceil(percent / 100.0 * count);
+	if (rank < 1) rank = 1;
+	return sorted[rank - 1];
+}
+
+/* TRUE if a CSV file is missing, empty or starts with benchCsvHeader, so rows can be appended to it */
+HIDDEN bool BenchCsvMatches(const char *file){
+	char line[1024];
+	FILE *in = fopen(file, "r");
+	if (in == NULL) return TRUE;
+	bool matches = fgets(line, sizeof(line), in) == NULL || !strcmp(line, benchCsvHeader);
+	fclose(in);
+	return matches;
+}
+
+/* ---- ReportBench() ---------------------------------------
+* Parameters: 	frames recorded in benchTimings, run description
+*				(including sprites on the map and -edits per frame)
+*				The ray precision and any map size the build is fixed
+*				to are added from the build itself.
+* Type: 		Public
+* Return:		None
+* Description:
+*	Summarises frame times (min/mean/p50/p95/p99), the mean of
+*	each stage, rays per second of casting and the mean number of
+*	cells visited per ray (DDA steps, or lookups when skipping
+*	empty space), skipping the first
+*	BENCH_WARMUP frames. Written as JSON, or appended as a CSV row
+*	when -benchout names a .csv file. A CSV file whose header has
+*	other columns (written by another version) is left alone and
+*	the summary goes to the terminal as JSON instead.
+* --------------------------------- end ReportBench() ---- */
+void ReportBench(int frames, int width, int height, int threads, const char *kernel, const char *grid, const char *map, int sprites, int edits){
+	int first = frames > BENCH_WARMUP * 2 ? BENCH_WARMUP : 0;
+	int count = frames - first;
+	double *total = malloc(sizeof(double) * count);
+	FrameTiming mean = {0, 0, 0, 0, 0, 0, 0, 0, 0};
+
+	for (int i = 0; i < count; i++){
+		FrameTiming *timing = &benchTimings[first + i];
+		total[i] = timing->total;
+		mean.total += timing->total / count;
+		mean.cast += timing->cast / count;
+		mean.draw += timing->draw / count;
+		mean.present += timing->present / count;
+		mean.steps += timing->steps / count;
+		mean.cached += timing->cached / count;
+		mean.scale += timing->scale / count;
+	}
+	qsort(total, count, sizeof(double), CompareDouble);
+	double raysPerSecond = mean.cast > 0 ? width * mean.scale / (mean.cast / 1000.0) : 0;
+
+	char fixedSize[32] = "none";	// builds for one map size (WORLD_FIXED_X/Y)
+#if defined(WORLD_FIXED_X) && defined(WORLD_FIXED_Y)
+	snprintf(fixedSize, sizeof(fixedSize), "%ix%i", WORLD_FIXED_X, WORLD_FIXED_Y);
+#endif
+
+	bool csv = benchOutFile != NULL && strlen(benchOutFile) > 4 && !strcmp(benchOutFile + strlen(benchOutFile) - 4, ".csv");
+	FILE *out = stdout;
+	if (csv && !BenchCsvMatches(benchOutFile)){
+		printf("%s%s%s\n", "Not appending to ", benchOutFile, ": its columns differ from this version's, move it aside to start a new one");
+		csv = FALSE;
+	}
+	else if (benchOutFile != NULL){
+		out = fopen(benchOutFile, csv ? "a" : "w");
+		if (out == NULL){
+			printf("%s%s\n", "Could not write ", benchOutFile);
+			out = stdout;
+		}
+	}
+
+	if (csv){
+		if (ftell(out) == 0) fputs(benchCsvHeader, out);
+		fprintf(out, "%s,%s,%i,%i,%i,%i,%s,%s,%s,%s,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.0f,%.2f,%.1f,%.3f,%i,%i\n",
+			benchPathFile, map, count, width, height, threads, kernel, grid, rayPrecisionNames[RAY_PRECISION], fixedSize,
+			total[0], mean.total, Percentile(total, count, 50), Percentile(total, count, 95), Percentile(total, count, 99),
+			mean.cast, mean.draw, mean.present, raysPerSecond, mean.steps, 100.0 * mean.cached, mean.scale, sprites, edits);
+	}
+	else{
+		fprintf(out, "{\"path\": \"%s\", \"map\": \"%s\", \"frames\": %i, \"width\": %i, \"height\": %i, \"threads\": %i, \"kernel\": \"%s\",\n",
+			benchPathFile, map, count, width, height, threads, kernel);
+		fprintf(out, " \"grid\": \"%s\", \"precision\": \"%s\", \"fixed_size\": \"%s\", \"sprites\": %i, \"edits\": %i,\n",
+			grid, rayPrecisionNames[RAY_PRECISION], fixedSize, sprites, edits);
+		fprintf(out, " \"frame_ms\": {\"min\": %.4f, \"mean\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f},\n",
+			total[0], mean.total, Percentile(total, count, 50), Percentile(total, count, 95), Percentile(total, count, 99));
+		fprintf(out, " \"stage_ms\": {\"cast\": %.4f, \"draw\": %.4f, \"present\": %.4f},\n", mean.cast, mean.draw, mean.present);
+		fprintf(out, " \"rays_per_sec\": %.0f, \"steps_per_ray\": %.2f, \"cached_pct\": %.1f, \"mean_scale\": %.3f, \"fps\": %.1f}\n", raysPerSecond, mean.steps,
+			100.0 * mean.cached, mean.scale, mean.total > 0 ? 1000.0 / mean.total : 0);
+	}
+
+	if (out != stdout) fclose(out);
+	free(total);
+}
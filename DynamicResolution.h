@@ -0,0 +1,116 @@
+/**************************************************************
+* FILENAME:		DynamicResolution.h
+*
+* DESCRIPTION:	Scales the resolution frames are cast at to hold a
+*				frame time budget.
+*
+* NOTES:		-target-ms 8 turns it on. The window keeps its size
+*				(WINDOW_WIDTH x WINDOW_HEIGHT) while frames are cast
+*				and drawn at SCREEN_WIDTH x SCREEN_HEIGHT, the same
+*				share of it on both axes, between -min-scale and 1.
+*				The renderer stretches each frame over the window
+*				when it is presented. Buffers are allocated for the
+*				whole window, so a new scale never reallocates.
+*				The main thread measures every frame it shows. Once
+*				SCALE_WINDOW frames rendered at the current scale are
+*				in, their mean time is compared with the budget:
+*				casting and drawing cost about the same per pixel, so
+*				the next scale is the current one times the square
+*				root of budget / mean, moving at most SCALE_STEP at a
+*				time. Means within SCALE_DEADBAND of the budget keep
+*				the scale, so it settles instead of hunting.
+*				The render side picks up a new scale when it starts
+*				its next frame, and only then rebuilds the per-column
+*				tables (the camera-space x of every column).
+**************************************************************/
+
+#define SCALE_GRAIN			1000	// scales are kept in thousandths, so threads can swap them atomically
+#define SCALE_WINDOW		8		// frames measured at one scale before deciding
+#define SCALE_STEP			0.15	// largest change of scale per decision
+#define SCALE_DEADBAND		0.05	// mean frame time within this share of the budget keeps the scale
+#define SCALE_MIN_PIXELS	16		// never cast fewer columns or rows than this
+
+// Dynamic resolution globals
+double targetFrameMs = 0;			// -target-ms, 0 = always cast at the window's resolution
+double minRenderScale = 0.5;		// -min-scale
+int requestedScale = SCALE_GRAIN;	// set by the main thread, picked up by the renderer
+int renderScale = SCALE_GRAIN;		// scale of the frame being rendered (renderer only)
+double scaleTimeSum = 0;			// frame times measured at requestedScale (main thread only)
+int scaleTimeFrames = 0;
+double *cameraXTable = NULL;		// camera-space x of every column at SCREEN_WIDTH
+int cameraXWidth = 0;				// width the table was built for, 0 = not built
+
+bool CreateResolutionTables(){
+	cameraXTable = malloc(sizeof(double) * WINDOW_WIDTH);
+	return cameraXTable != NULL;
+}
+
+void DestroyResolutionTables(){
+	free(cameraXTable);
+	cameraXTable = NULL;
+	cameraXWidth = 0;
+}
+
+/* ---- ApplyRenderScale() ---------------------------------------
+* Parameters: 	None
+* Type: 		Public
+* Return:		the scale the next frame is rendered at
+* Description:
+*	Called by whichever thread renders, before each frame. Takes
+*	the latest requested scale, sets SCREEN_WIDTH and SCREEN_HEIGHT
+*	from it and rebuilds the per-column tables if the width moved.
+* --------------------------------- end ApplyRenderScale() ---- */
+double ApplyRenderScale(){
+	int scale = __atomic_load_n(&requestedScale, __ATOMIC_RELAXED);
+
+	if (scale != renderScale){
+		renderScale = scale;
+		SCREEN_WIDTH = (int)((long)WINDOW_WIDTH * scale / SCALE_GRAIN);
+		SCREEN_HEIGHT = (int)((long)WINDOW_HEIGHT * scale / SCALE_GRAIN);
+		if (SCREEN_WIDTH < SCALE_MIN_PIXELS) SCREEN_WIDTH = WINDOW_WIDTH < SCALE_MIN_PIXELS ? WINDOW_WIDTH : SCALE_MIN_PIXELS;
+		if (SCREEN_HEIGHT < SCALE_MIN_PIXELS) SCREEN_HEIGHT = WINDOW_HEIGHT < SCALE_MIN_PIXELS ? WINDOW_HEIGHT : SCALE_MIN_PIXELS;
+	}
+	if (cameraXWidth != SCREEN_WIDTH && cameraXTable != NULL){
+		for (int x = 0; x < SCREEN_WIDTH; x++) cameraXTable[x] = 2 * x / ((double)(SCREEN_WIDTH) - 1); // x-coordinate in camera space
+		cameraXWidth = SCREEN_WIDTH;
+	}
+	return (double)renderScale / SCALE_GRAIN;
+}
+
+/* Camera-space x of column x at the current resolution */
+static inline double ColumnCameraX(int x){
+	if (cameraXTable != NULL) return cameraXTable[x];
+	return 2 * x / ((double)(SCREEN_WIDTH) - 1);
+}
+
+/* ---- MeasureFrameScale() ---------------------------------------
+* Parameters: 	timing - a frame that was just shown
+* Type: 		Public
+* Return:		None
+* Description:
+*	Adds the frame's time (its stages, not the frame rate limiter's
+*	wait) to the current measurement and, once SCALE_WINDOW frames
+*	are in, requests the scale that should bring the mean to the
+*	budget. Frames still in flight from before the last change are
+*	left out.
+* --------------------------------- end MeasureFrameScale() ---- */
+void MeasureFrameScale(const FrameTiming *timing){
+	if (targetFrameMs <= 0) return;
+	int current = requestedScale;
+	if ((int)(timing->scale * SCALE_GRAIN + 0.5) != current) return;
+
+	scaleTimeSum += timing->input + timing->cast + timing->draw + timing->overlay + timing->present;
+	if (++scaleTimeFrames < SCALE_WINDOW) return;
+	double mean = scaleTimeSum / scaleTimeFrames;
+	scaleTimeSum = 0;
+	scaleTimeFrames = 0;
+	if (mean <= 0 || fabs(mean - targetFrameMs) <= targetFrameMs * SCALE_DEADBAND) return;
+
+	double scale = (double)current / SCALE_GRAIN;
+	double next = scale * sqrt(targetFrameMs / mean);
+	if (next > scale + SCALE_STEP) next = scale + SCALE_STEP;
+	if (next < scale - SCALE_STEP) next = scale - SCALE_STEP;
+	if (next > 1) next = 1;
+	if (next < minRenderScale) next = minRenderScale;
+	__atomic_store_n(&requestedScale, (int)(next * SCALE_GRAIN + 0.5), __ATOMIC_RELAXED);
+}
@@ -0,0 +1,315 @@
+/**************************************************************
+* FILENAME:		Floors.h
+*
+* DESCRIPTION:	Floor and ceiling casting for the framebuffer
+*				renderers.
+*
+* NOTES:		Floors are drawn a screen row at a time before the
+*				walls, which then only write their own slices. Every
+*				pixel of a floor row is the same distance away
+*				(looked up per row from a table rebuilt only when the
+*				resolution changes), so the point of the floor under
+*				each pixel moves by a fixed step along the row. It is
+*				interpolated in texels from pixel 0 of the row as
+*				start + i * step in doubles (fixed point steps drift
+*				by pixels across a wide row up close), eight pixels at
+*				a time with AVX2 where available, then truncated to
+*				integer texel coordinates. The ceiling row the
+*				same distance above the horizon sees the same points,
+*				so both are drawn from one interpolation.
+*				The map has no floor layer, so map cells alternate
+*				between two floor (and ceiling) tiles like a
+*				checkerboard. Textured frames use built-in floor and
+*				ceiling textures; flat and indexed frames shade the
+*				tiles with distance like the indexed walls.
+*				Rows are independent, so bands of them are spread
+*				over the worker pool. The draw-call renderer instead
+*				copies a pre-rendered shaded background each frame.
+*				-floors off keeps the black background.
+**************************************************************/
+
+#define FLOOR_ROWS			8		// floor rows (and their ceiling rows) per ParallelFor() tile
+#define FLOOR_TEXTURE_BITS	6		// log2(TEXTURE_SIZE)
+#define FLOOR_BIAS			16384.0	// cells added to floor points so they truncate like floor(); even, to keep the checkerboard
+#define FLOOR_TILES			4		// floor and ceiling, two tiles each
+#define FLOOR_PALETTE		(1 + WALL_COLORS * 2 * SHADE_BANDS)	// first palette index after the walls'
+
+// Floor globals
+bool floorsEnabled = TRUE;			// -floors off
+Uint32 floorTextures[FLOOR_TILES][TEXTURE_TEXELS];	// [tile][texY][texX], floor tiles then ceiling tiles
+Uint32 floorShades[FLOOR_TILES][SHADE_BANDS];		// flat tile colors by distance band
+const Uint32 floorColors[FLOOR_TILES] = {0x6E6E6E, 0x5A5A5A, 0x3C2C1C, 0x30241A};
+double *rowDistance = NULL;			// distance of the floor seen by each row below the horizon
+int rowDistanceHeight = 0;			// SCREEN_HEIGHT the table was built for, 0 = not built
+SDL_Texture *backgroundTexture = NULL;	// shaded floor and ceiling for the draw-call renderer
+CameraState floorCamera;			// camera of the frame the floor is being drawn for
+
+/* ---- CreateFloors() ---------------------------------------
+* Parameters: 	None
+* Type: 		Public
+* Return:		TRUE on success
+* Description:
+*	Generates the floor and ceiling textures (flagstones and
+*	boards), the shaded tile colors and, in indexed mode, their
+*	palette entries, and allocates the row distance table.
+* --------------------------------- end CreateFloors() ---- */
+bool CreateFloors(){
+	rowDistance = malloc(sizeof(double) * WINDOW_HEIGHT);
+	if (rowDistance == NULL) return FALSE;
+	rowDistanceHeight = 0;
+
+	for (int y = 0; y < TEXTURE_SIZE; y++){
+		for (int x = 0; x < TEXTURE_SIZE; x++){
+			// Flagstones: four per tile with dark joints and a little mottling
+			bool joint = x % 32 == 0 || y % 32 == 0;
+			int mottle = ((x * 7 + y * 13) ^ (x * y)) & 15;
+			// Boards: running along x, a dark gap every 16 texels
+			bool gap = y % 16 == 0;
+			int grain = (int)(12 * sin(x * 0.3 + y * 0.7));
+			for (int tile = 0; tile < 2; tile++){
+				Uint32 stone = floorColors[tile] + (Uint32)mottle * 0x010101;
+				Uint32 board = floorColors[2 + tile] + (Uint32)(grain + 12) * 0x010100;
+				floorTextures[tile][y * TEXTURE_SIZE + x] = COLOR_BLACK | (joint ? 0x303030 : stone);
+				floorTextures[2 + tile][y * TEXTURE_SIZE + x] = COLOR_BLACK | (gap ? 0x140C04 : board);
+			}
+		}
+	}
+	for (int tile = 0; tile < FLOOR_TILES; tile++){
+		for (int band = 0; band < SHADE_BANDS; band++){
+			floorShades[tile][band] = ShadeColor(floorColors[tile], band);
+			if (indexBuffer != NULL) palette[FLOOR_PALETTE + tile * SHADE_BANDS + band] = floorShades[tile][band];
+		}
+	}
+	return TRUE;
+}
+
+void DestroyFloors(){
+	free(rowDistance);
+	rowDistance = NULL;
+	rowDistanceHeight = 0;
+	if (backgroundTexture != NULL) SDL_DestroyTexture(backgroundTexture);
+	backgroundTexture = NULL;
+}
+
+/* Floor rows at the current resolution: the horizon row and everything below it */
+static inline int FloorRowCount(){
+	return SCREEN_HEIGHT - SCREEN_HEIGHT / 2;
+}
+
+/* ---- PrepareFloors() ---------------------------------------
+* Parameters: 	camera of the frame
+* Type: 		Public
+* Return:		number of FloorBand() tiles to run
+* Description:
+*	Called once per frame before the bands are drawn. Rebuilds the
+*	row distance table if the resolution changed: row k below the
+*	horizon looks at the floor through its pixel centre, k + 0.5
+*	rows down, which is SCREEN_HEIGHT / 2 / (k + 0.5) cells away,
+*	matching how tall walls are drawn.
+* --------------------------------- end PrepareFloors() ---- */
+int PrepareFloors(const CameraState *camera){
+	int rows = FloorRowCount();
+	if (rowDistanceHeight != SCREEN_HEIGHT){
+		for (int k = 0; k < rows; k++) rowDistance[k] = 0.5 * SCREEN_HEIGHT / (k + 0.5);
+		rowDistanceHeight = SCREEN_HEIGHT;
+	}
+	floorCamera = *camera;
+	return (rows + FLOOR_ROWS - 1) / FLOOR_ROWS;
+}
+
+/* Tile (0 or 1) of the cell under a floor point given in texels, and the offset of its texel */
+static inline Uint32 FloorTexel(Uint32 texelX, Uint32 texelY){
+	return (((texelX ^ texelY) >> FLOOR_TEXTURE_BITS & 1) << (2 * FLOOR_TEXTURE_BITS))
+		| ((texelY & (TEXTURE_SIZE - 1)) << FLOOR_TEXTURE_BITS)
+		| (texelX & (TEXTURE_SIZE - 1));
+}
+
+/* ---- TextureFloorRow() ---------------------------------------
+* Parameters: 	output row, pixel count, the two tile textures,
+*				floor point of the first pixel and its step, in
+*				texels
+* Type: 		Public
+* Return:		None
+* Description:
+*	Samples a floor or ceiling row. Each point is computed from
+*	its pixel number rather than a running sum, so the loop
+*	vectorizes (see SampleStrip()).
+* --------------------------------- end TextureFloorRow() ---- */
+__attribute__((optimize("tree-vectorize", "vect-cost-model=dynamic")))
+void TextureFloorRow(Uint32 *restrict out, int count, const Uint32 *restrict textures, double texelX, double texelY, double stepX, double stepY){
+	for (int i = 0; i < count; i++){
+		out[i] = textures[FloorTexel((Uint32)(int)(texelX + i * stepX), (Uint32)(int)(texelY + i * stepY))];
+	}
+}
+
+#ifdef PALETTE_X86
+/* Floor points of eight pixels, in texels, truncated to integers */
+__attribute__((target("avx2")))
+static inline __m256i FloorTexels8(__m256d start, __m256d step, __m256d first, __m256d second){
+	__m128i low = _mm256_cvttpd_epi32(_mm256_add_pd(start, _mm256_mul_pd(first, step)));
+	__m128i high = _mm256_cvttpd_epi32(_mm256_add_pd(start, _mm256_mul_pd(second, step)));
+	return _mm256_inserti128_si256(_mm256_castsi128_si256(low), high, 1);
+}
+
+/* TextureFloorRow() eight pixels at a time, with one gather per eight texels */
+__attribute__((target("avx2")))
+void TextureFloorRowAVX2(Uint32 *out, int count, const Uint32 *textures, double texelX, double texelY, double stepX, double stepY){
+	const __m256i texelMask = _mm256_set1_epi32(TEXTURE_SIZE - 1);
+	const __m256i one = _mm256_set1_epi32(1);
+	const __m256d startX = _mm256_set1_pd(texelX);
+	const __m256d startY = _mm256_set1_pd(texelY);
+	const __m256d stepsX = _mm256_set1_pd(stepX);
+	const __m256d stepsY = _mm256_set1_pd(stepY);
+	__m256d first = _mm256_setr_pd(0, 1, 2, 3);		// pixel numbers of the two halves
+	__m256d second = _mm256_setr_pd(4, 5, 6, 7);
+	const __m256d eight = _mm256_set1_pd(8);
+	int i = 0;
+
+	for (; i + 8 <= count; i += 8){
+		__m256i pointX = FloorTexels8(startX, stepsX, first, second);
+		__m256i pointY = FloorTexels8(startY, stepsY, first, second);
+		__m256i tile = _mm256_and_si256(_mm256_srli_epi32(_mm256_xor_si256(pointX, pointY), FLOOR_TEXTURE_BITS), one);
+		__m256i texel = _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi32(tile, 2 * FLOOR_TEXTURE_BITS),
+			_mm256_slli_epi32(_mm256_and_si256(pointY, texelMask), FLOOR_TEXTURE_BITS)), _mm256_and_si256(pointX, texelMask));
+		_mm256_storeu_si256((__m256i *)(out + i), _mm256_i32gather_epi32((const int *)textures, texel, 4));
+		first = _mm256_add_pd(first, eight);
+		second = _mm256_add_pd(second, eight);
+	}
+	for (; i < count; i++) out[i] = textures[FloorTexel((Uint32)(int)(texelX + i * stepX), (Uint32)(int)(texelY + i * stepY))];
+}
+#endif
+
+/* Flat floor row: each pixel takes its cell's tile color */
+__attribute__((optimize("tree-vectorize", "vect-cost-model=dynamic")))
+void FlatFloorRow(Uint32 *restrict out, int count, Uint32 color0, Uint32 color1, double texelX, double texelY, double stepX, double stepY){
+	for (int i = 0; i < count; i++){
+		Uint32 tile = ((Uint32)(int)(texelX + i * stepX) ^ (Uint32)(int)(texelY + i * stepY)) >> FLOOR_TEXTURE_BITS & 1;
+		out[i] = tile ? color1 : color0;
+	}
+}
+
+/* FlatFloorRow() for the index buffer */
+__attribute__((optimize("tree-vectorize", "vect-cost-model=dynamic")))
+void IndexedFloorRow(Uint8 *restrict out, int count, Uint8 index0, Uint8 index1, double texelX, double texelY, double stepX, double stepY){
+	for (int i = 0; i < count; i++){
+		Uint32 tile = ((Uint32)(int)(texelX + i * stepX) ^ (Uint32)(int)(texelY + i * stepY)) >> FLOOR_TEXTURE_BITS & 1;
+		out[i] = tile ? index1 : index0;
+	}
+}
+
+/* ---- FloorRows() ---------------------------------------
+* Parameters: 	floor row and its ceiling row (NULL if off the
+*				screen), their width, distance of the floor they
+*				see, camera, columnStep - camera-space x between
+*				two columns
+* Type: 		Public
+* Return:		None
+* Description:
+*	Draws one floor row and its ceiling row in ARGB8888, textured
+*	when walls are. Column x looks along dir + plane * cameraX,
+*	so at distance d the floor point is pos + d * dir plus x steps
+*	of d * plane * columnStep; points are passed on in texels,
+*	shifted by FLOOR_BIAS cells so they stay positive.
+* --------------------------------- end FloorRows() ---- */
+void FloorRows(Uint32 *floorRow, Uint32 *ceilingRow, int width, double distance, const CameraState *camera, double columnStep){
+	static int avx2 = -1;
+	if (avx2 < 0) avx2 = __builtin_cpu_supports("avx2") ? 1 : 0; // same answer on every thread
+	double floorX = (FLOOR_BIAS + camera->posX + distance * camera->dirX) * TEXTURE_SIZE;
+	double floorY = (FLOOR_BIAS + camera->posY + distance * camera->dirY) * TEXTURE_SIZE;
+	double stepX = distance * camera->planeX * columnStep * TEXTURE_SIZE;
+	double stepY = distance * camera->planeY * columnStep * TEXTURE_SIZE;
+
+	if (textureAtlas != NULL){
+		for (int tiles = 0; tiles <= 2; tiles += 2){
+			Uint32 *row = tiles == 0 ? floorRow : ceilingRow;
+			if (row == NULL) continue;
+#ifdef PALETTE_X86
+			if (avx2){
+				TextureFloorRowAVX2(row, width, floorTextures[tiles], floorX, floorY, stepX, stepY);
+				continue;
+			}
+#endif
+			TextureFloorRow(row, width, floorTextures[tiles], floorX, floorY, stepX, stepY);
+		}
+		return;
+	}
+	int shade = ShadeBand(distance);
+	FlatFloorRow(floorRow, width, floorShades[0][shade], floorShades[1][shade], floorX, floorY, stepX, stepY);
+	if (ceilingRow != NULL) FlatFloorRow(ceilingRow, width, floorShades[2][shade], floorShades[3][shade], floorX, floorY, stepX, stepY);
+}
+
+/* ---- FloorBand() ---------------------------------------
+* Parameters: 	band - index of a group of FLOOR_ROWS floor rows
+* Type: 		Public
+* Return:		None
+* Description:
+*	Draws FLOOR_ROWS rows below the horizon and the matching rows
+*	above it into frameBuffer (see FloorRows()), or indexBuffer
+*	in indexed mode.
+* --------------------------------- end FloorBand() ---- */
+void FloorBand(int band, void *unused){
+	const CameraState *camera = &floorCamera;
+	int rows = FloorRowCount();
+	int horizon = SCREEN_HEIGHT / 2;
+	int end = (band + 1) * FLOOR_ROWS;
+	if (end > rows) end = rows;
+	double columnStep = 2 / ((double)(SCREEN_WIDTH) - 1);
+
+	for (int k = band * FLOOR_ROWS; k < end; k++){
+		double distance = rowDistance[k];
+		int floorRow = horizon + k;
+		int ceilingRow = horizon - 1 - k;	// below row 0 for the last row when the height is odd
+
+		if (renderMode == RENDER_INDEXED){
+			double floorX = (FLOOR_BIAS + camera->posX + distance * camera->dirX) * TEXTURE_SIZE;
+			double floorY = (FLOOR_BIAS + camera->posY + distance * camera->dirY) * TEXTURE_SIZE;
+			double stepX = distance * camera->planeX * columnStep * TEXTURE_SIZE;
+			double stepY = distance * camera->planeY * columnStep * TEXTURE_SIZE;
+			int shade = ShadeBand(distance);
+			IndexedFloorRow(indexBuffer + (size_t)floorRow * SCREEN_WIDTH, SCREEN_WIDTH,
+				FLOOR_PALETTE + shade, FLOOR_PALETTE + SHADE_BANDS + shade, floorX, floorY, stepX, stepY);
+			if (ceilingRow >= 0) IndexedFloorRow(indexBuffer + (size_t)ceilingRow * SCREEN_WIDTH, SCREEN_WIDTH,
+				FLOOR_PALETTE + 2 * SHADE_BANDS + shade, FLOOR_PALETTE + 3 * SHADE_BANDS + shade, floorX, floorY, stepX, stepY);
+		}
+		else{
+			FloorRows(frameBuffer + (size_t)floorRow * SCREEN_WIDTH, ceilingRow >= 0 ? frameBuffer + (size_t)ceilingRow * SCREEN_WIDTH : NULL,
+				SCREEN_WIDTH, distance, camera, columnStep);
+		}
+	}
+}
+
+/* ---- CreateBackground() ---------------------------------------
+* Parameters: 	None
+* Type: 		Public
+* Return:		TRUE on success
+* Description:
+*	For the draw-call renderer, which can't afford a draw call per
+*	floor pixel: renders the floor and ceiling once, shaded by row
+*	distance in the first tile's color, into a texture that
+*	DrawBackground() copies under every frame.
+* --------------------------------- end CreateBackground() ---- */
+bool CreateBackground(){
+	Uint32 *pixels = malloc(sizeof(Uint32) * WINDOW_WIDTH * WINDOW_HEIGHT);
+	int horizon = WINDOW_HEIGHT / 2;
+
+	backgroundTexture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC, WINDOW_WIDTH, WINDOW_HEIGHT);
+	if (pixels == NULL || backgroundTexture == NULL){
+		free(pixels);
+		return FALSE;
+	}
+	for (int k = 0; k < WINDOW_HEIGHT - horizon; k++){
+		int shade = ShadeBand(0.5 * WINDOW_HEIGHT / (k + 0.5));
+		for (int x = 0; x < WINDOW_WIDTH; x++){
+			pixels[(size_t)(horizon + k) * WINDOW_WIDTH + x] = floorShades[0][shade];
+			if (horizon - 1 - k >= 0) pixels[(size_t)(horizon - 1 - k) * WINDOW_WIDTH + x] = floorShades[2][shade];
+		}
+	}
+	SDL_UpdateTexture(backgroundTexture, NULL, pixels, WINDOW_WIDTH * sizeof(Uint32));
+	free(pixels);
+	return TRUE;
+}
+
+/* Copy the background under the columns about to be drawn */
+void DrawBackground(){
+	if (backgroundTexture != NULL) SDL_RenderCopy(renderer, backgroundTexture, NULL, NULL);
+}
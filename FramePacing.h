@@ -0,0 +1,51 @@
+/**************************************************************
+* FILENAME:		FramePacing.h
+*
+* DESCRIPTION:	Frame rate limiting.
+*
+* NOTES:		Frames are paced on SDL_GetPerformanceCounter():
+*				each one gets an exact deadline, most of the wait is
+*				slept with SDL_Delay() and the last SPIN_MARGIN_MS is
+*				spun, since SDL_Delay() may oversleep by about that
+*				much. -limitfps 144 therefore really means 6.94 ms.
+*				Short frame periods spin for at most a quarter of the
+*				period, and without a limit (FPS_UNCAPPED, the
+*				default) nothing waits at all.
+*				The player simulation keeps its own fixed-step
+*				schedule (PlayerThread.h).
+**************************************************************/
+
+#define SPIN_MARGIN_MS		2
+
+// Frame pacing globals
+Uint64 paceNext = 0;			// counter value the next frame starts at, 0 before the first
+
+/* ---- PaceFrame() ---------------------------------------
+* Parameters: 	fps - frame rate limit
+* Type: 		Public
+* Return:		None
+* Description:
+*	Waits until the current frame's deadline, then sets the next
+*	one a whole frame period later, so small oversleeps don't add
+*	up. A frame that ran more than a period late restarts the
+*	schedule from now instead of rushing to catch up. Returns at
+*	once when fps is 0 or FPS_UNCAPPED or more.
+* --------------------------------- end PaceFrame() ---- */
+void PaceFrame(int fps){
+	Uint64 frequency = SDL_GetPerformanceFrequency();
+	Uint64 now = SDL_GetPerformanceCounter();
+	Uint64 period, spin;
+
+	if (fps <= 0 || fps >= FPS_UNCAPPED) return;
+	period = frequency / fps;
+	spin = frequency * SPIN_MARGIN_MS / 1000;
+	if (spin > period / 4) spin = period / 4;
+	if (paceNext == 0 || now >= paceNext + period) paceNext = now;
+
+	while (now < paceNext){
+		Uint64 sleepMs = paceNext - now > spin ? (paceNext - now - spin) * 1000 / frequency : 0;
+		if (sleepMs > 0) SDL_Delay((Uint32)sleepMs);
+		now = SDL_GetPerformanceCounter();
+	}
+	paceNext += period;
+}
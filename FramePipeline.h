@@ -0,0 +1,197 @@
+/**************************************************************
+* FILENAME:		FramePipeline.h
+*
+* DESCRIPTION:	Pipelined frame production: one thread renders the
+*				next frame while the main thread presents the last.
+*
+* NOTES:		Frames live in PIPELINE_SLOTS framebuffers. Empty
+*				slots wait in a free queue and rendered ones in a
+*				ready queue, both bounded, so each thread blocks only
+*				when the other is behind. SDL must be called from the
+*				main thread, which therefore keeps upload, overlay and
+*				present; the render thread casts, draws (on the
+*				worker pool) and, in indexed mode, expands the frame.
+*				-pipeline latency uses two slots: the next frame is
+*				rendered while the last is presented, and never more.
+*				-pipeline throughput uses three, so rendering can run
+*				a frame further ahead, at the cost of showing a camera
+*				one frame older.
+*				Both threads' waits are counted, which shows which
+*				side of the pipeline holds the other up.
+**************************************************************/
+
+#define PIPELINE_OFF		0
+#define PIPELINE_LATENCY	1
+#define PIPELINE_THROUGHPUT	2
+#define PIPELINE_SLOTS		3
+
+// One frame in flight
+typedef struct {
+	Uint32 *pixels;			// room for WINDOW_WIDTH * WINDOW_HEIGHT, ARGB8888
+	int width;				// size the frame was rendered at
+	int height;
+	FrameTiming timing;		// cast/draw from the render thread, the rest from the main thread
+	int frame;				// number of the frame, counting from 0
+} PipelineSlot;
+
+// Bounded FIFO of slot numbers
+typedef struct {
+	int slots[PIPELINE_SLOTS];
+	int head;
+	int count;
+	pthread_mutex_t mutex;
+	pthread_cond_t changed;
+} SlotQueue;
+
+// Where a stalled thread's time goes
+typedef struct {
+	long frames;
+	double renderWait;		// ms the render thread waited for a free slot (presenting is the bottleneck)
+	double presentWait;		// ms the main thread waited for a rendered frame (rendering is the bottleneck)
+	double readySum;		// frames already waiting, summed over every frame the main thread took
+	Uint64 start;
+} PipelineStats;
+
+typedef void (*FrameProducer)(PipelineSlot *slot);
+
+// Pipeline globals
+int pipelineMode = PIPELINE_OFF;	// set by -pipeline
+PipelineSlot pipelineSlots[PIPELINE_SLOTS];
+SlotQueue freeSlots;
+SlotQueue readySlots;
+PipelineStats pipelineStats;
+FrameProducer pipelineProducer;
+pthread_t pipelineThread;
+int pipelineQuit = FALSE;
+const char *pipelineModeNames[] = {"off", "latency", "throughput"};
+
+HIDDEN void InitSlotQueue(SlotQueue *queue){
+	queue->head = 0;
+	queue->count = 0;
+	pthread_mutex_init(&queue->mutex, NULL);
+	pthread_cond_init(&queue->changed, NULL);
+}
+
+HIDDEN void PushSlot(SlotQueue *queue, int slot){
+	pthread_mutex_lock(&queue->mutex);
+	queue->slots[(queue->head + queue->count) % PIPELINE_SLOTS] = slot;
+	queue->count++;
+	pthread_cond_signal(&queue->changed);
+	pthread_mutex_unlock(&queue->mutex);
+}
+
+/* Take the oldest slot, waiting for one if needed; -1 once the pipeline stops. Adds the wait to *waited and returns how many were queued */
+HIDDEN int PopSlot(SlotQueue *queue, double *waited, int *queued){
+	int slot = -1;
+	Uint64 start = SDL_GetPerformanceCounter();
+	pthread_mutex_lock(&queue->mutex);
+	*queued = queue->count;
+	while (queue->count == 0 && !pipelineQuit){
+		pthread_cond_wait(&queue->changed, &queue->mutex);
+	}
+	if (queue->count > 0 && !pipelineQuit){
+		slot = queue->slots[queue->head];
+		queue->head = (queue->head + 1) % PIPELINE_SLOTS;
+		queue->count--;
+	}
+	pthread_mutex_unlock(&queue->mutex);
+	*waited += ElapsedMs(start, SDL_GetPerformanceCounter());
+	return slot;
+}
+
+HIDDEN void FreePipelineSlots(){
+	for (int i = 0; i < PIPELINE_SLOTS; i++){
+		free(pipelineSlots[i].pixels);
+		pipelineSlots[i].pixels = NULL;
+	}
+}
+
+HIDDEN void *PipelineThreadMain(void *unused){
+	int frame = 0;
+	for (;;){
+		double waited = 0;
+		int queued;
+		int slot = PopSlot(&freeSlots, &waited, &queued);
+		if (slot < 0) return NULL;
+		pipelineStats.renderWait += waited; // only this thread writes it
+		pipelineSlots[slot].frame = frame++;
+		pipelineProducer(&pipelineSlots[slot]);
+		PushSlot(&readySlots, slot);
+	}
+}
+
+/* ---- StartPipeline() ---------------------------------------
+* Parameters: 	mode, producer - renders one frame into a slot
+* Type: 		Public
+* Return:		TRUE if the render thread is running
+* Description:
+*	Allocates the slots for the mode, queues them all as free and
+*	starts the render thread, which begins on frame 0 at once.
+* --------------------------------- end StartPipeline() ---- */
+bool StartPipeline(int mode, FrameProducer producer){
+	int slots = mode == PIPELINE_THROUGHPUT ? 3 : 2;
+
+	InitSlotQueue(&freeSlots);
+	InitSlotQueue(&readySlots);
+	for (int i = 0; i < slots; i++){
+		pipelineSlots[i].pixels = malloc(sizeof(Uint32) * WINDOW_WIDTH * WINDOW_HEIGHT);
+		if (pipelineSlots[i].pixels == NULL){
+			printf("%s\n", "Out of memory for the frame pipeline");
+			FreePipelineSlots();
+			return FALSE;
+		}
+		PushSlot(&freeSlots, i);
+	}
+	memset(&pipelineStats, 0, sizeof(pipelineStats));
+	pipelineStats.start = SDL_GetPerformanceCounter();
+	pipelineProducer = producer;
+	pipelineQuit = FALSE;
+	if (pthread_create(&pipelineThread, NULL, PipelineThreadMain, NULL) != 0){
+		printf("%s\n", "Could not start the render thread");
+		FreePipelineSlots();
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/* Next rendered frame, waiting for it if needed; hand it back with ReleaseFrame() once presented */
+PipelineSlot *AcquireFrame(){
+	int queued;
+	int slot = PopSlot(&readySlots, &pipelineStats.presentWait, &queued);
+	pipelineStats.readySum += queued;
+	pipelineStats.frames++;
+	return &pipelineSlots[slot];
+}
+
+void ReleaseFrame(PipelineSlot *slot){
+	PushSlot(&freeSlots, (int)(slot - pipelineSlots));
+}
+
+/* Stop the render thread (it finishes the frame it is on) and free the slots */
+void StopPipeline(){
+	pthread_mutex_lock(&freeSlots.mutex);
+	pipelineQuit = TRUE;
+	pthread_cond_broadcast(&freeSlots.changed);
+	pthread_mutex_unlock(&freeSlots.mutex);
+	pthread_join(pipelineThread, NULL);
+	FreePipelineSlots();
+}
+
+/* ---- ReportPipeline() ---------------------------------------
+* Parameters: 	output file
+* Type: 		Public
+* Return:		None
+* Description:
+*	Prints what share of the run each thread spent waiting on the
+*	other and how many rendered frames were usually queued: a busy
+*	render thread with an idle presenter means casting is the
+*	bottleneck, and the reverse means upload/present is.
+* --------------------------------- end ReportPipeline() ---- */
+void ReportPipeline(FILE *out){
+	double elapsed = ElapsedMs(pipelineStats.start, SDL_GetPerformanceCounter());
+	if (pipelineStats.frames == 0 || elapsed <= 0) return;
+	fprintf(out, "%s%s%s%li%s%.1f%s%.1f%s%.2f\n", "Pipeline (", pipelineModeNames[pipelineMode], "): ", pipelineStats.frames,
+		" frames, render thread waited ", 100.0 * pipelineStats.renderWait / elapsed,
+		"%, presenter waited ", 100.0 * pipelineStats.presentWait / elapsed,
+		"%, frames ready on average ", pipelineStats.readySum / pipelineStats.frames);
+}
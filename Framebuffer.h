@@ -0,0 +1,76 @@
+/**************************************************************
+* FILENAME:		Framebuffer.h
+*
+* DESCRIPTION:	CPU-side 32-bit framebuffer that RayCast() writes
+*				columns into directly.
+*
+* NOTES:		The whole frame is handed to SDL once per frame
+*				(one SDL_UpdateTexture + one SDL_RenderCopy) instead
+*				of one draw call per column/pixel.
+*				The old draw-call path is kept behind -framebuffer 0.
+**************************************************************/
+
+#define NEAREST_WALL		(1.0 / 65536)	// walls closer than this (float and fixed point rays can report 0) are drawn this close
+
+// Framebuffer globals
+int renderMode = RENDER_FRAMEBUFFER;
+Uint32 *frameBuffer = NULL;		// room for WINDOW_WIDTH * WINDOW_HEIGHT pixels, the frame is SCREEN_WIDTH * SCREEN_HEIGHT of them, row-major, ARGB8888
+SDL_Texture *frameTexture = NULL;	// streaming texture the buffer is uploaded into
+bool clearAroundWalls = TRUE;		// FALSE when floors and ceilings are drawn before the walls
+
+/* Allocate the pixel buffer and its streaming texture */
+bool CreateFramebuffer(){
+	frameBuffer = malloc(sizeof(Uint32) * WINDOW_WIDTH * WINDOW_HEIGHT);
+	frameTexture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, WINDOW_WIDTH, WINDOW_HEIGHT);
+	if (frameBuffer == NULL || frameTexture == NULL){
+		printf("%s%s\n", "Could not create framebuffer: ", SDL_GetError());
+		return FALSE;
+	}
+	return TRUE;
+}
+
+void DestroyFramebuffer(){
+	if (frameTexture != NULL) SDL_DestroyTexture(frameTexture);
+	free(frameBuffer);
+	frameTexture = NULL;
+	frameBuffer = NULL;
+}
+
+/* Rows a wall slice at the given distance covers in a column height pixels tall; returns its unclipped height */
+static inline int WallSliceRows(int height, double perpWallDist, int *drawStart, int *drawEnd){
+	if (!(perpWallDist >= NEAREST_WALL)) perpWallDist = NEAREST_WALL; // keeps lineHeight within an int
+	int lineHeight = (int)(height / perpWallDist);
+	*drawStart = -lineHeight / 2 + height / 2;
+	if (*drawStart < 0) *drawStart = 0;
+	*drawEnd = lineHeight / 2 + height / 2;
+	if (*drawEnd >= height) *drawEnd = height - 1;
+	return lineHeight;
+}
+
+/* Fill a column of height pixels, pitch apart: the wall slice, and black above and below it if clear */
+void FillStrip(Uint32 *pixel, int pitch, int height, int y1, int y2, Uint32 color, bool clear){
+	int y = 0;
+
+	if (y1 < 0) y1 = 0; //clip
+	if (y2 >= height) y2 = height - 1; //clip
+	if (!clear){
+		y = y1;
+		pixel += (size_t)y1 * pitch;
+	}
+
+	for (; y < y1; y++, pixel += pitch) *pixel = COLOR_BLACK;
+	for (; y <= y2; y++, pixel += pitch) *pixel = color;
+	for (; clear && y < height; y++, pixel += pitch) *pixel = COLOR_BLACK;
+}
+
+/* Fill one screen column: the wall slice, and black above and below it unless floors are already there */
+void FillColumn(int x, int y1, int y2, Uint32 color){
+	FillStrip(frameBuffer + x, SCREEN_WIDTH, SCREEN_HEIGHT, y1, y2, color, clearAroundWalls);
+}
+
+/* Upload a finished frame (frameBuffer, or a pipeline slot) of the given size and queue it, stretched over the window, for SDL_RenderPresent() */
+void PresentFramebuffer(const Uint32 *pixels, int width, int height){
+	SDL_Rect frame = {0, 0, width, height};
+	SDL_UpdateTexture(frameTexture, &frame, pixels, width * sizeof(Uint32));
+	SDL_RenderCopy(renderer, frameTexture, &frame, NULL);
+}
@@ -0,0 +1,101 @@
+/**************************************************************
+* FILENAME:		MapConvert.c
+*
+* DESCRIPTION:	Writes .p3dm map files for the -map argument.
+*
+* NOTES:		Built once per map header, e.g.
+*					gcc MapConvert.c -DMAP_HEADER='"map2.h"' -o map_convert
+*					./map_convert map2.p3dm
+*				converts the compiled-in worldMap of that header.
+*				With -generate it writes a synthetic world instead,
+*				which is how large test maps are made:
+*					./map_convert -generate 4096 4096 0.02 1 world4096.p3dm
+*				(size, fraction of walls, seed).
+*				Open edges are walled off, as the engine requires.
+*				"make maps" and "make bigmap" drive this.
+**************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "const.h"
+#include "MapLoader.h"
+
+#ifndef MAP_HEADER
+#define MAP_HEADER "map1.h"
+#endif
+#include MAP_HEADER
+
+#define SPAWN_CLEARANCE		3	// generated maps keep every cell this close to the spawn empty
+
+int main(int argc, char *argv[]){
+	int sizeX = WORLD_HEIGHT;
+	int sizeY = WORLD_WIDTH;
+	int spawnX = -1;
+	int spawnY = -1;
+	double density = -1;
+	unsigned int seed = 1;
+	char *output = NULL;
+	uint8_t *cells;
+
+	/* Argument Variables */
+	for (int i = 1; i < argc; i++){
+		if (!strcmp(argv[i], "-generate") && (i+4) < argc){
+			sizeX = atoi(argv[i+1]);
+			sizeY = atoi(argv[i+2]);
+			density = atof(argv[i+3]);
+			seed = (unsigned int)atoi(argv[i+4]);
+			i += 4;
+		}
+		else if (!strcmp(argv[i], "-spawn") && (i+2) < argc){
+			spawnX = atoi(argv[i+1]);
+			spawnY = atoi(argv[i+2]);
+			i += 2;
+		}
+		else{
+			output = argv[i];
+		}
+	}
+	if (output == NULL || sizeX < 3 || sizeY < 3){
+		printf("%s\n", "usage: map_convert [-generate sizeX sizeY density seed] [-spawn x y] out.p3dm");
+		return EXIT_FAILURE;
+	}
+
+	if (density >= 0){
+		cells = GenerateMap(sizeX, sizeY, density, seed);
+		if (cells == NULL){
+			printf("%s\n", "Out of memory");
+			return EXIT_FAILURE;
+		}
+		// Start in the middle, clearing a small room around it so scripted camera paths stay out of walls
+		if (spawnX < 0){
+			spawnX = sizeX / 2;
+			spawnY = sizeY / 2;
+		}
+		for (int x = spawnX - SPAWN_CLEARANCE; x <= spawnX + SPAWN_CLEARANCE; x++){
+			for (int y = spawnY - SPAWN_CLEARANCE; y <= spawnY + SPAWN_CLEARANCE; y++){
+				if (x > 0 && y > 0 && x < sizeX - 1 && y < sizeY - 1) cells[(size_t)x * sizeY + y] = 0;
+			}
+		}
+	}
+	else{
+		cells = calloc((size_t)sizeX * sizeY, 1);
+		for (int x = 0; x < sizeX; x++){
+			for (int y = 0; y < sizeY; y++){
+				int value = worldMap[x][y];
+				cells[(size_t)x * sizeY + y] = value < 0 ? 0 : (value > 255 ? 255 : value);
+			}
+		}
+		if (!MapIsEnclosed(cells, sizeX, sizeY)){
+			printf("%s%s%s\n", "Note: ", MAP_HEADER, " has open edges, walling them off");
+			EncloseMap(cells, sizeX, sizeY);
+		}
+	}
+
+	if (!SaveMapFile(output, cells, sizeX, sizeY, spawnX, spawnY)){
+		free(cells);
+		return EXIT_FAILURE;
+	}
+	printf("%s%s (%ix%i)\n", "Wrote ", output, sizeX, sizeY);
+	free(cells);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,348 @@
+/**************************************************************
+* FILENAME:		MapEdit.h
+*
+* DESCRIPTION:	Changes cells of the loaded world while it is being
+*				rendered: doors, destruction, level editing.
+*
+* NOTES:		EditMapCells() may be called from any thread. It only
+*				queues the batch; ApplyMapEdits() applies everything
+*				queued at the start of the next frame, on the thread
+*				that renders it, before any ray is cast. The worker
+*				threads are idle then, so every frame's rays see the
+*				map exactly as it was after one whole number of
+*				batches, without taking a lock per cell or per ray:
+*				the frame boundary is the switch between revisions.
+*				The queue's lock is held only to add to it and to
+*				swap it out, never while cells change.
+*				Applying a batch writes the byte cells (a mapped file
+*				turns copy-on-write first, so only the 4 KB pages
+*				touched are copied) and the occupancy plane's bits,
+*				then recomputes the distance field only around the
+*				cells that went from wall to empty or back: as far
+*				out as a distance can change, found from the old
+*				field before it is touched (DistanceReach()). Only
+*				CastRaySkip() reads the field, so with another kernel
+*				selected it is just marked stale, and rebuilt whole
+*				at the first frame that casts with the skip kernel
+*				again. The
+*				map's revision then moves on by one, and the view
+*				cache recasts only the columns whose rays cross the
+*				edited box. Sprites don't depend on the walls, so
+*				they need nothing.
+*				Movement on the player thread runs outside the frame
+*				boundary: it reads the occupancy plane with atomic
+*				loads (SolidBitAtomic()) that pair with the atomic
+*				read-modify-writes here, so while a batch is being
+*				applied it may see some of its cells changed and
+*				others not yet, each one either old or new. RayQuery.h
+*				batches read the map like rays do, so run them between
+*				frames too.
+*				Edits must leave the outer wall alone, since rays and
+*				movement rely on it; a batch that touches it is
+*				refused whole.
+*				-edits N toggles N random cells every frame, to see
+*				what steady editing costs.
+**************************************************************/
+
+#define MAP_EDIT_SEED		7
+
+typedef struct {
+	int x;					// cell (mapX, mapY)
+	int y;
+	uint8_t cell;			// its new material, 0 = empty
+} MapEdit;
+
+// Map edit globals
+int editsPerFrame = 0;			// -edits N
+pthread_mutex_t editLock = PTHREAD_MUTEX_INITIALIZER;
+MapEdit *queuedEdits = NULL;	// filled by EditMapCells()
+int queuedCount = 0;
+int queuedCapacity = 0;
+MapEdit *applyingEdits = NULL;	// swapped with the queue by ApplyMapEdits()
+int applyingCapacity = 0;
+long editBatches = 0;			// frames that applied edits
+long editedCells = 0;			// cells that changed
+double editMsTotal = 0;
+double editMsMax = 0;
+MapEdit *randomEdits = NULL;	// EditRandomCells()' batch, allocated once
+int randomCapacity = 0;
+
+/* A box of cells, corners inclusive */
+typedef struct {
+	int minX;
+	int minY;
+	int maxX;
+	int maxY;
+} CellBox;
+
+/* ---- EditMapCells() ---------------------------------------
+* Parameters: 	count edits
+* Type: 		Public
+* Return:		TRUE if the batch was queued
+* Description:
+*	Queues a batch of cell changes for the next frame. Later edits
+*	of the same cell win. Wakes an idle main loop, so the change
+*	shows even when nothing else moves.
+* --------------------------------- end EditMapCells() ---- */
+bool EditMapCells(const MapEdit *edits, int count){
+	for (int i = 0; i < count; i++){
+		if (edits[i].x < 1 || edits[i].y < 1 || edits[i].x >= world.sizeX - 1 || edits[i].y >= world.sizeY - 1){
+			printf("%s%i, %i\n", "Map edits must stay inside the outer wall, refused a batch editing ", edits[i].x, edits[i].y);
+			return FALSE;
+		}
+	}
+	pthread_mutex_lock(&editLock);
+	if (queuedCount + count > queuedCapacity){
+		int capacity = queuedCapacity > 0 ? queuedCapacity : 64;
+		while (capacity < queuedCount + count) capacity *= 2;
+		MapEdit *grown = realloc(queuedEdits, sizeof(MapEdit) * capacity);
+		if (grown == NULL){
+			pthread_mutex_unlock(&editLock);
+			printf("%s\n", "Out of memory for map edits");
+			return FALSE;
+		}
+		queuedEdits = grown;
+		queuedCapacity = capacity;
+	}
+	memcpy(queuedEdits + queuedCount, edits, sizeof(MapEdit) * count);
+	__atomic_store_n(&queuedCount, queuedCount + count, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&editLock);
+
+	if (waitingForInput){
+		SDL_Event wake;
+		memset(&wake, 0, sizeof(wake));
+		wake.type = SDL_USEREVENT;
+		SDL_PushEvent(&wake);
+	}
+	return TRUE;
+}
+
+/* TRUE if edits are waiting for the next frame */
+bool MapEditsPending(){
+	return __atomic_load_n(&queuedCount, __ATOMIC_ACQUIRE) > 0;
+}
+
+/* ---- DistanceReach() ---------------------------------------
+* Parameters: 	cell (x, y) and whether it becomes a wall
+* Type: 		Public
+* Return:		how far from the cell distances can change, -1 if
+*				none can
+* Description:
+*	Reads the distance field from before the edit, a ring of
+*	cells at a time. A new wall lowers exactly the distances
+*	greater than their ring; a removed wall can only raise those
+*	equal to their ring (it was their nearest). Distances differ
+*	by at most one between neighbours, so once a whole ring has
+*	none of these, no ring further out does either.
+* --------------------------------- end DistanceReach() ---- */
+int DistanceReach(int x, int y, bool wall){
+	for (int ring = 0; ring <= 255; ring++){
+		bool changes = FALSE;
+		for (int cx = x - ring; cx <= x + ring && !changes; cx++){
+			if (cx < 0 || cx >= world.sizeX) continue;
+			const uint8_t *row = world.distance + (size_t)cx * world.sizeY;
+			bool side = cx == x - ring || cx == x + ring;	// whole row of the ring, otherwise just its two ends
+			for (int cy = y - ring; cy <= y + ring; cy += side || ring == 0 ? 1 : 2 * ring){
+				if (cy < 0 || cy >= world.sizeY) continue;
+				if (wall ? row[cy] > ring : row[cy] == ring){
+					changes = TRUE;
+					break;
+				}
+			}
+		}
+		if (!changes) return ring - 1;
+	}
+	return 255;
+}
+
+/* Grow a box by the reach around a cell, clipped to the map */
+HIDDEN CellBox ReachBox(int x, int y, int reach){
+	CellBox box = {x - reach, y - reach, x + reach, y + reach};
+	if (box.minX < 0) box.minX = 0;
+	if (box.minY < 0) box.minY = 0;
+	if (box.maxX > world.sizeX - 1) box.maxX = world.sizeX - 1;
+	if (box.maxY > world.sizeY - 1) box.maxY = world.sizeY - 1;
+	return box;
+}
+
+/* ---- MergeTouchingBoxes() ---------------------------------------
+* Parameters: 	count boxes
+* Type: 		Public
+* Return:		how many are left
+* Description:
+*	Merges boxes until none overlaps or borders another. A box's
+*	distances are recomputed from the cells just outside it, so
+*	those must not belong to a box still to be done.
+* --------------------------------- end MergeTouchingBoxes() ---- */
+int MergeTouchingBoxes(CellBox *boxes, int count){
+	bool merged = TRUE;
+	while (merged){
+		merged = FALSE;
+		for (int i = 0; i < count; i++){
+			for (int j = i + 1; j < count; j++){
+				CellBox *a = &boxes[i];
+				const CellBox *b = &boxes[j];
+				if (a->minX > b->maxX + 1 || b->minX > a->maxX + 1 || a->minY > b->maxY + 1 || b->minY > a->maxY + 1) continue;
+				if (b->minX < a->minX) a->minX = b->minX;
+				if (b->minY < a->minY) a->minY = b->minY;
+				if (b->maxX > a->maxX) a->maxX = b->maxX;
+				if (b->maxY > a->maxY) a->maxY = b->maxY;
+				boxes[j--] = boxes[--count];
+				merged = TRUE;
+			}
+		}
+	}
+	return count;
+}
+
+/* ---- ApplyMapEdits() ---------------------------------------
+* Parameters: 	None
+* Type: 		Public
+* Return:		number of cells changed
+* Description:
+*	Applies every queued edit to the cells, the occupancy plane
+*	and the distance field, and moves the map to its next revision
+*	with the box of cells changed. The distance field is kept up
+*	to date only while the skip kernel is selected; a stale one is
+*	rebuilt here once that kernel is selected again. Call it only
+*	while no rays are being cast: RenderFrame() does at the start
+*	of every frame, and callers of RenderCameraBatch() should
+*	between batches.
+* --------------------------------- end ApplyMapEdits() ---- */
+int ApplyMapEdits(){
+	bool skipping = world.distance != NULL && rayKernel == KERNEL_SKIP;
+	if (skipping && world.distanceStale){
+		DistanceWindow(world.distance, 0, 0, world.sizeX - 1, world.sizeY - 1);
+		world.distanceStale = 0;
+	}
+	if (!MapEditsPending()) return 0;
+	Uint64 start = SDL_GetPerformanceCounter();
+
+	pthread_mutex_lock(&editLock);
+	MapEdit *edits = queuedEdits;
+	int count = queuedCount;
+	int capacity = queuedCapacity;
+	queuedEdits = applyingEdits;
+	queuedCapacity = applyingCapacity;
+	__atomic_store_n(&queuedCount, 0, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&editLock);
+	applyingEdits = edits;
+	applyingCapacity = capacity;
+
+	uint8_t *cells = WritableCells();
+	if (cells == NULL){
+		printf("%s%i%s\n", "The map can't be written to, dropped ", count, " edits");
+		return 0;
+	}
+	CellBox *boxes = skipping ? malloc(sizeof(CellBox) * count) : NULL;
+	CellBox reaches = {world.sizeX, world.sizeY, -1, -1};	// all of them, in case there's no room for boxes
+	CellBox edited = {world.sizeX, world.sizeY, -1, -1};
+	int boxCount = 0;
+	int changed = 0;
+
+	for (int i = 0; i < count; i++){
+		int x = edits[i].x;
+		int y = edits[i].y;
+		uint8_t *cell = &cells[(size_t)x * WORLD_ROW + y];
+		if (*cell == edits[i].cell) continue;
+		bool wall = edits[i].cell != 0;
+		if ((*cell != 0) != wall){
+			int reach = skipping ? DistanceReach(x, y, wall) : -1;
+			if (world.distance != NULL && !skipping) world.distanceStale = 1;
+			if (reach >= 0){
+				CellBox box = ReachBox(x, y, reach);
+				if (boxes != NULL) boxes[boxCount++] = box;
+				if (box.minX < reaches.minX) reaches.minX = box.minX;
+				if (box.minY < reaches.minY) reaches.minY = box.minY;
+				if (box.maxX > reaches.maxX) reaches.maxX = box.maxX;
+				if (box.maxY > reaches.maxY) reaches.maxY = box.maxY;
+			}
+			uint64_t index = MortonIndex(x, y);
+			if (wall) __atomic_fetch_or(&world.solid[index >> 6], 1ull << (index & 63), __ATOMIC_RELAXED);
+			else __atomic_fetch_and(&world.solid[index >> 6], ~(1ull << (index & 63)), __ATOMIC_RELAXED);
+		}
+		*cell = edits[i].cell;
+		if (x < edited.minX) edited.minX = x;
+		if (y < edited.minY) edited.minY = y;
+		if (x > edited.maxX) edited.maxX = x;
+		if (y > edited.maxY) edited.maxY = y;
+		changed++;
+	}
+	if (boxes == NULL && reaches.maxX >= 0){
+		DistanceWindow(world.distance, reaches.minX, reaches.minY, reaches.maxX, reaches.maxY);
+	}
+	boxCount = MergeTouchingBoxes(boxes, boxCount);
+	for (int i = 0; i < boxCount; i++) DistanceWindow(world.distance, boxes[i].minX, boxes[i].minY, boxes[i].maxX, boxes[i].maxY);
+	free(boxes);
+
+	if (changed > 0){
+		world.editBase = world.revision;
+		world.editMinX = edited.minX;
+		world.editMinY = edited.minY;
+		world.editMaxX = edited.maxX;
+		world.editMaxY = edited.maxY;
+		world.revision++;
+	}
+	double elapsed = ElapsedMs(start, SDL_GetPerformanceCounter());
+	editBatches++;
+	editedCells += changed;
+	editMsTotal += elapsed;
+	if (elapsed > editMsMax) editMsMax = elapsed;
+	return changed;
+}
+
+/* xorshift32, like GenerateMap() */
+HIDDEN uint32_t EditRandom(uint32_t *state){
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+	return *state;
+}
+
+/* ---- EditRandomCells() ---------------------------------------
+* Parameters: 	count cells to toggle, cell (avoidX, avoidY) to
+*				leave alone
+* Type: 		Public
+* Return:		None
+* Description:
+*	Queues count edits of random inner cells, the same ones every
+*	run: walls are knocked down and empty cells get a wall of a
+*	random color. For -edits; the camera's cell is left alone so
+*	the player is never walled in.
+* --------------------------------- end EditRandomCells() ---- */
+void EditRandomCells(int count, int avoidX, int avoidY){
+	static uint32_t random = MAP_EDIT_SEED;
+	if (count > randomCapacity){
+		MapEdit *grown = realloc(randomEdits, sizeof(MapEdit) * count);
+		if (grown == NULL){
+			printf("%s\n", "Out of memory for map edits");
+			return;
+		}
+		randomEdits = grown;
+		randomCapacity = count;
+	}
+	MapEdit *edits = randomEdits;
+	for (int i = 0; i < count; i++){
+		do{
+			edits[i].x = 1 + (int)(EditRandom(&random) % (uint32_t)(world.sizeX - 2));
+			edits[i].y = 1 + (int)(EditRandom(&random) % (uint32_t)(world.sizeY - 2));
+		} while (edits[i].x == avoidX && edits[i].y == avoidY);
+		edits[i].cell = WORLD_CELL(edits[i].x, edits[i].y) != 0 ? 0 : 1 + EditRandom(&random) % 4;
+	}
+	EditMapCells(edits, count);
+}
+
+void FreeMapEdits(){
+	free(queuedEdits);
+	free(applyingEdits);
+	free(randomEdits);
+	queuedEdits = applyingEdits = randomEdits = NULL;
+	queuedCount = queuedCapacity = applyingCapacity = randomCapacity = 0;
+}
+
+/* One line summary for the end of a run */
+void ReportMapEdits(FILE *out){
+	if (editBatches == 0) return;
+	fprintf(out, "%s%li%s%li%s%.3f%s%.3f%s\n", "Map edits: ", editedCells, " cells changed in ", editBatches, " frames, ",
+		editMsTotal / editBatches, " ms mean, ", editMsMax, " ms at most");
+}
@@ -0,0 +1,503 @@
+/**************************************************************
+* FILENAME:		MapLoader.h
+*
+* DESCRIPTION:	The world grid the renderer and collision code read,
+*				and the compact on-disk map format it is loaded from.
+*
+* NOTES:		Map file layout (little-endian):
+*					0	"P3DM"
+*					4	uint32 version (MAP_FILE_VERSION)
+*					8	uint32 sizeX	rows, the first map index
+*					12	uint32 sizeY	columns, the second map index
+*					16	uint32 spawnX	cell the player starts in
+*					20	uint32 spawnY
+*					24	uint32 reserved (0)
+*					28	uint32 reserved (0)
+*					32	uint8 cells[sizeX * sizeY], cell (x, y) at x * sizeY + y
+*					..	MAP_FILE_PADDING zero bytes
+*				Files are mmap'd read-only and used in place, so even
+*				very large worlds start without a copy; the first map
+*				edit (MapEdit.h) makes the mapping copy-on-write, so
+*				only the pages edited are ever copied, and the file
+*				itself is never written. The padding
+*				lets SIMD kernels read a whole 32-bit word at the
+*				last cell.
+*				Maps must be enclosed by walls: rays and movement
+*				never check bounds, they rely on hitting the edge.
+*				BuildDistanceField() derives, for every cell, how far
+*				the nearest wall is; CastRaySkip() uses it to jump
+*				over open space.
+*				Every loaded world also gets an occupancy plane: one
+*				bit per cell, set for walls, in Morton (Z) order over
+*				a power-of-two square. Each 64-bit word is an 8x8
+*				block of cells and each 64-byte line a 32x16 block, so
+*				a ray heading any way stays in the same few lines for
+*				dozens of steps, and a 4096x4096 world's plane is 2 MB
+*				instead of 16. Hit tests and collisions read it
+*				(WORLD_SOLID()); the byte cells stay the material plane
+*				that picks colors and textures (WORLD_CELL()).
+*				Building with -DWORLD_FIXED_X=... -DWORLD_FIXED_Y=...
+*				compiles the map size into the byte plane's indexing;
+*				such a build only loads maps of exactly that size.
+**************************************************************/
+#ifndef MAP_LOADER_H
+#define MAP_LOADER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "const.h"
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#define MAP_FILE_MAGIC		"P3DM"
+#define MAP_FILE_VERSION	1
+#define MAP_FILE_HEADER		32
+#define MAP_FILE_PADDING	4
+#define MAP_NO_SPAWN		0xFFFFFFFFu
+#define MORTON_X			0xAAAAAAAAAAAAAAAAull	// bits of a Morton index that hold x (mapX)
+#define MORTON_Y			0x5555555555555555ull	// and y (mapY)
+
+typedef struct {
+	char magic[4];
+	uint32_t version;
+	uint32_t sizeX;
+	uint32_t sizeY;
+	uint32_t spawnX;
+	uint32_t spawnY;
+	uint32_t reserved[2];
+} MapFileHeader;
+
+/* The loaded world: either a mapping of a map file or a private copy */
+typedef struct {
+	int sizeX;				// rows (first index, mapX)
+	int sizeY;				// columns (second index, mapY)
+	const uint8_t *cells;	// cell (x, y) at cells[x * sizeY + y]
+	int spawnX;
+	int spawnY;
+	void *mapping;			// whole file when mmap'd, NULL otherwise
+	size_t mappingSize;
+	uint8_t *owned;			// private copy (compiled-in maps, no mmap)
+	uint8_t *distance;		// Chebyshev distance to the nearest wall (0 = wall), NULL until built
+	int distanceStale;		// walls were edited since, while nothing cast with it (MapEdit.h)
+	uint64_t *solid;		// occupancy plane: bit MortonIndex(x, y) set for walls
+	int solidSide;			// the plane covers solidSide x solidSide cells, a power of two
+	unsigned int revision;	// changes whenever cells do, so cached views know to recast
+	unsigned int editBase;	// revision the last applied edit batch (MapEdit.h) started from,
+	int editMinX;			// and the cells it changed: cached views only recast what saw them
+	int editMinY;
+	int editMaxX;
+	int editMaxY;
+	int writable;			// cells may be changed in place (mapped files are made copy-on-write first)
+} WorldMap;
+
+WorldMap world;
+
+// Row length of the byte plane, a constant in builds for one map size
+#ifdef WORLD_FIXED_Y
+#define WORLD_ROW			((size_t)WORLD_FIXED_Y)
+#else
+#define WORLD_ROW			((size_t)world.sizeY)
+#endif
+
+/* Material of a cell: 0 = empty, otherwise the wall's color/texture */
+#define WORLD_CELL(x, y)	(world.cells[(size_t)(x) * WORLD_ROW + (y)])
+/* 1 if a cell is a wall, from the occupancy plane */
+#define WORLD_SOLID(x, y)	SolidBit(MortonIndex(x, y))
+
+/* Spread the 32 bits of v to the even bits of the result */
+static inline uint64_t DilateBits(uint32_t v){
+	uint64_t d = v;
+	d = (d | (d << 16)) & 0x0000FFFF0000FFFFull;
+	d = (d | (d << 8)) & 0x00FF00FF00FF00FFull;
+	d = (d | (d << 4)) & 0x0F0F0F0F0F0F0F0Full;
+	d = (d | (d << 2)) & 0x3333333333333333ull;
+	d = (d | (d << 1)) & 0x5555555555555555ull;
+	return d;
+}
+
+/* Gather the even bits of d back together (undoes DilateBits()) */
+static inline uint32_t CompactBits(uint64_t d){
+	d &= 0x5555555555555555ull;
+	d = (d | (d >> 1)) & 0x3333333333333333ull;
+	d = (d | (d >> 2)) & 0x0F0F0F0F0F0F0F0Full;
+	d = (d | (d >> 4)) & 0x00FF00FF00FF00FFull;
+	d = (d | (d >> 8)) & 0x0000FFFF0000FFFFull;
+	d = (d | (d >> 16)) & 0x00000000FFFFFFFFull;
+	return (uint32_t)d;
+}
+
+static inline uint64_t MortonIndex(int x, int y){
+	return DilateBits((uint32_t)x) << 1 | DilateBits((uint32_t)y);
+}
+
+/* ---- MortonStep() ---------------------------------------
+* Parameters: 	m - the x or y bits of a Morton index, move - from
+*				MortonMove(), mask - MORTON_X or MORTON_Y
+* Type: 		Public
+* Return:		the bits of the neighbouring cell
+* Description:
+*	Steps one coordinate of a Morton index without taking it
+*	apart: m - mask adds one (the borrow runs through the other
+*	coordinate's zero bits), m - lowest bit subtracts one; either
+*	way masking clears what leaked into the other coordinate.
+* --------------------------------- end MortonStep() ---- */
+static inline uint64_t MortonStep(uint64_t m, uint64_t move, uint64_t mask){
+	return (m - move) & mask;
+}
+
+static inline uint64_t MortonMove(int step, uint64_t mask){
+	return step > 0 ? mask : (mask & (~mask + 1));
+}
+
+static inline int SolidBit(uint64_t index){
+	return (int)(world.solid[index >> 6] >> (index & 63)) & 1;
+}
+
+/* SolidBit() for threads that run while map edits are applied (MapEdit.h) */
+static inline int SolidBitAtomic(uint64_t index){
+	return (int)(__atomic_load_n(&world.solid[index >> 6], __ATOMIC_RELAXED) >> (index & 63)) & 1;
+}
+
+/* TRUE if a position lies inside the map's outer wall, where rays cast from it can only end on the map */
+static inline int InsideMap(double x, double y){
+	return x >= 1 && y >= 1 && x < world.sizeX - 1 && y < world.sizeY - 1;
+}
+
+/* TRUE if this build can use a map of the given size (builds for one size only take that size) */
+int MapSizeSupported(int sizeX, int sizeY){
+#if defined(WORLD_FIXED_X) && defined(WORLD_FIXED_Y)
+	if (sizeX != WORLD_FIXED_X || sizeY != WORLD_FIXED_Y){
+		printf("%s%ix%i%s%ix%i\n", "This build only runs ", WORLD_FIXED_X, WORLD_FIXED_Y, " maps, not ", sizeX, sizeY);
+		return 0;
+	}
+#else
+	(void)sizeX;
+	(void)sizeY;
+#endif
+	return 1;
+}
+
+/* ---- BuildOccupancy() ---------------------------------------
+* Parameters: 	None
+* Type: 		Public
+* Return:		TRUE on success
+* Description:
+*	Fills world.solid from the cells. The plane is padded to a
+*	power-of-two square so any cell's Morton index is in it;
+*	padding cells are empty, and never reached on an enclosed map.
+* --------------------------------- end BuildOccupancy() ---- */
+int BuildOccupancy(){
+	int side = 8;
+	while (side < world.sizeX || side < world.sizeY) side <<= 1;
+	uint64_t *solid = calloc((size_t)side * side / 64, sizeof(uint64_t));
+	if (solid == NULL) return 0;
+
+	for (int x = 0; x < world.sizeX; x++){
+		uint64_t mortonX = DilateBits((uint32_t)x) << 1;
+		uint64_t mortonY = 0;
+		for (int y = 0; y < world.sizeY; y++){
+			uint64_t index = mortonX | mortonY;
+			if (WORLD_CELL(x, y) != 0) solid[index >> 6] |= 1ull << (index & 63);
+			mortonY = MortonStep(mortonY, MORTON_Y, MORTON_Y);
+		}
+	}
+
+	free(world.solid);
+	world.solid = solid;
+	world.solidSide = side;
+	return 1;
+}
+
+/* TRUE if every edge cell is a wall */
+int MapIsEnclosed(const uint8_t *cells, int sizeX, int sizeY){
+	for (int x = 0; x < sizeX; x++){
+		if (cells[(size_t)x * sizeY] == 0 || cells[(size_t)x * sizeY + sizeY - 1] == 0) return 0;
+	}
+	for (int y = 0; y < sizeY; y++){
+		if (cells[y] == 0 || cells[(size_t)(sizeX - 1) * sizeY + y] == 0) return 0;
+	}
+	return 1;
+}
+
+/* Turn any open edge cell into a wall (only for maps we own) */
+void EncloseMap(uint8_t *cells, int sizeX, int sizeY){
+	for (int x = 0; x < sizeX; x++){
+		if (cells[(size_t)x * sizeY] == 0) cells[(size_t)x * sizeY] = 1;
+		if (cells[(size_t)x * sizeY + sizeY - 1] == 0) cells[(size_t)x * sizeY + sizeY - 1] = 1;
+	}
+	for (int y = 0; y < sizeY; y++){
+		if (cells[y] == 0) cells[y] = 1;
+		if (cells[(size_t)(sizeX - 1) * sizeY + y] == 0) cells[(size_t)(sizeX - 1) * sizeY + y] = 1;
+	}
+}
+
+/* First empty cell in row-major order, used when a map has no spawn point */
+HIDDEN void FindSpawn(WorldMap *map){
+	for (size_t i = 0; i < (size_t)map->sizeX * map->sizeY; i++){
+		if (map->cells[i] == 0){
+			map->spawnX = (int)(i / map->sizeY);
+			map->spawnY = (int)(i % map->sizeY);
+			return;
+		}
+	}
+	map->spawnX = map->sizeX / 2;
+	map->spawnY = map->sizeY / 2;
+}
+
+void FreeWorldMap(){
+#ifndef _WIN32
+	if (world.mapping != NULL) munmap(world.mapping, world.mappingSize);
+#endif
+	free(world.owned);
+	free(world.distance);
+	free(world.solid);
+	memset(&world, 0, sizeof(world));
+}
+
+/* Use a compiled-in int map (map1.h style) as the world; values are clamped to a byte */
+int LoadCompiledMap(const int *cells, int sizeX, int sizeY){
+	size_t count = (size_t)sizeX * sizeY;
+	if (!MapSizeSupported(sizeX, sizeY)) return 0;
+	world.owned = calloc(count + MAP_FILE_PADDING, 1);
+	if (world.owned == NULL) return 0;
+	for (size_t i = 0; i < count; i++){
+		world.owned[i] = cells[i] < 0 ? 0 : (cells[i] > 255 ? 255 : (uint8_t)cells[i]);
+	}
+	if (!MapIsEnclosed(world.owned, sizeX, sizeY)){
+		printf("%s\n", "Compiled-in map has open edges, walling them off");
+		EncloseMap(world.owned, sizeX, sizeY);
+	}
+	world.sizeX = sizeX;
+	world.sizeY = sizeY;
+	world.cells = world.owned;
+	world.mapping = NULL;
+	FindSpawn(&world);
+	if (!BuildOccupancy()){
+		printf("%s\n", "Out of memory for the occupancy plane");
+		FreeWorldMap();
+		return 0;
+	}
+	return 1;
+}
+
+/* world.cells for writing, NULL if they can't be; a mapped file turns copy-on-write the first time */
+uint8_t *WritableCells(){
+	if (!world.writable && world.owned == NULL){
+#ifndef _WIN32
+		if (world.mapping == NULL || mprotect(world.mapping, world.mappingSize, PROT_READ | PROT_WRITE) != 0) return NULL;
+#else
+		return NULL;
+#endif
+	}
+	world.writable = 1;
+	return (uint8_t *)world.cells;
+}
+
+/* ---- LoadMapFile() ---------------------------------------
+* Parameters: 	path of a .p3dm map file
+* Type: 		Public
+* Return:		TRUE on success
+* Description:
+*	Maps the file read-only and points world.cells straight at
+*	its payload. Falls back to reading it into memory where mmap
+*	is not available.
+* --------------------------------- end LoadMapFile() ---- */
+int LoadMapFile(const char *path){
+	MapFileHeader header;
+	FILE *file = fopen(path, "rb");
+	if (file == NULL){
+		printf("%s%s\n", "Could not open map ", path);
+		return 0;
+	}
+	size_t got = fread(&header, sizeof(header), 1, file);
+	fseek(file, 0, SEEK_END);
+	long fileSize = ftell(file);
+	fclose(file);
+
+	if (got != 1 || memcmp(header.magic, MAP_FILE_MAGIC, 4) != 0 || header.version != MAP_FILE_VERSION){
+		printf("%s%s\n", "Not a version 1 map file: ", path);
+		return 0;
+	}
+	size_t count = (size_t)header.sizeX * header.sizeY;
+	if (header.sizeX < 3 || header.sizeY < 3 || header.sizeX > INT32_MAX / header.sizeY || (size_t)fileSize < MAP_FILE_HEADER + count + MAP_FILE_PADDING){
+		printf("%s%s\n", "Map file is truncated or has bad dimensions: ", path);
+		return 0;
+	}
+	if (!MapSizeSupported((int)header.sizeX, (int)header.sizeY)) return 0;
+
+#ifndef _WIN32
+	int fd = open(path, O_RDONLY);
+	void *mapping = fd < 0 ? MAP_FAILED : mmap(NULL, (size_t)fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (fd >= 0) close(fd); // the mapping keeps the file alive
+	if (mapping == MAP_FAILED){
+		printf("%s%s\n", "Could not map ", path);
+		return 0;
+	}
+	madvise(mapping, (size_t)fileSize, MADV_WILLNEED); // start paging in without blocking
+	world.mapping = mapping;
+	world.mappingSize = (size_t)fileSize;
+	world.owned = NULL;
+	world.cells = (const uint8_t *)mapping + MAP_FILE_HEADER;
+#else
+	world.owned = malloc(count + MAP_FILE_PADDING);
+	file = fopen(path, "rb");
+	if (world.owned == NULL || file == NULL) return 0;
+	fseek(file, MAP_FILE_HEADER, SEEK_SET);
+	fread(world.owned, 1, count + MAP_FILE_PADDING, file);
+	fclose(file);
+	world.mapping = NULL;
+	world.cells = world.owned;
+#endif
+	world.sizeX = (int)header.sizeX;
+	world.sizeY = (int)header.sizeY;
+
+	if (!MapIsEnclosed(world.cells, world.sizeX, world.sizeY)){
+		printf("%s%s\n", "Map is not enclosed by walls: ", path);
+		FreeWorldMap();
+		return 0;
+	}
+	if (header.spawnX < header.sizeX && header.spawnY < header.sizeY && WORLD_CELL(header.spawnX, header.spawnY) == 0){
+		world.spawnX = (int)header.spawnX;
+		world.spawnY = (int)header.spawnY;
+	}
+	else{
+		FindSpawn(&world);
+	}
+	if (!BuildOccupancy()){
+		printf("%s\n", "Out of memory for the occupancy plane");
+		FreeWorldMap();
+		return 0;
+	}
+	return 1;
+}
+
+/* ---- DistanceWindow() ---------------------------------------
+* Parameters: 	distance field, corners of a window of cells (inclusive)
+* Type: 		Public
+* Return:		None
+* Description:
+*	Recomputes the distance field inside the window. Two passes of
+*	a 3x3 chamfer give the exact chessboard distance, one sweeping
+*	forward from the top-left neighbours and one back from the
+*	bottom-right ones. Neighbours outside the window are read as
+*	they are, so they must already hold their final distances;
+*	for the whole map there are none.
+* --------------------------------- end DistanceWindow() ---- */
+void DistanceWindow(uint8_t *distance, int x0, int y0, int x1, int y1){
+	const int sizeX = world.sizeX;
+	const int sizeY = world.sizeY;
+
+	for (int x = x0; x <= x1; x++){
+		uint8_t *row = distance + (size_t)x * sizeY;
+		const uint8_t *above = row - sizeY;
+		for (int y = y0; y <= y1; y++){
+			int nearest = 254;
+			if (WORLD_CELL(x, y) != 0){
+				row[y] = 0;
+				continue;
+			}
+			if (y > 0 && row[y - 1] < nearest) nearest = row[y - 1];
+			if (x > 0){
+				if (above[y] < nearest) nearest = above[y];
+				if (y > 0 && above[y - 1] < nearest) nearest = above[y - 1];
+				if (y < sizeY - 1 && above[y + 1] < nearest) nearest = above[y + 1];
+			}
+			row[y] = nearest + 1;
+		}
+	}
+	for (int x = x1; x >= x0; x--){
+		uint8_t *row = distance + (size_t)x * sizeY;
+		const uint8_t *below = row + sizeY;
+		for (int y = y1; y >= y0; y--){
+			int nearest = row[y] - 1;
+			if (nearest <= 0) continue;
+			if (y < sizeY - 1 && row[y + 1] < nearest) nearest = row[y + 1];
+			if (x < sizeX - 1){
+				if (below[y] < nearest) nearest = below[y];
+				if (y > 0 && below[y - 1] < nearest) nearest = below[y - 1];
+				if (y < sizeY - 1 && below[y + 1] < nearest) nearest = below[y + 1];
+			}
+			row[y] = nearest + 1;
+		}
+	}
+}
+
+/* ---- BuildDistanceField() ---------------------------------------
+* Parameters: 	None
+* Type: 		Public
+* Return:		TRUE on success
+* Description:
+*	Fills world.distance with each cell's Chebyshev (chessboard)
+*	distance to the nearest wall, capped at 255: a cell at distance
+*	d has only empty cells within d-1 of it in every direction.
+*	One DistanceWindow() over the whole map, so even a 4096x4096
+*	world takes only a few milliseconds.
+* --------------------------------- end BuildDistanceField() ---- */
+int BuildDistanceField(){
+	uint8_t *distance = malloc((size_t)world.sizeX * world.sizeY);
+	if (distance == NULL) return 0;
+	DistanceWindow(distance, 0, 0, world.sizeX - 1, world.sizeY - 1);
+
+	free(world.distance);
+	world.distance = distance;
+	world.distanceStale = 0;
+	return 1;
+}
+
+/* Write cells as a map file (used by the converter) */
+int SaveMapFile(const char *path, const uint8_t *cells, int sizeX, int sizeY, int spawnX, int spawnY){
+	MapFileHeader header;
+	uint8_t padding[MAP_FILE_PADDING] = {0};
+	FILE *file = fopen(path, "wb");
+	if (file == NULL){
+		printf("%s%s\n", "Could not write map ", path);
+		return 0;
+	}
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, MAP_FILE_MAGIC, 4);
+	header.version = MAP_FILE_VERSION;
+	header.sizeX = (uint32_t)sizeX;
+	header.sizeY = (uint32_t)sizeY;
+	header.spawnX = spawnX < 0 ? MAP_NO_SPAWN : (uint32_t)spawnX;
+	header.spawnY = spawnY < 0 ? MAP_NO_SPAWN : (uint32_t)spawnY;
+	int ok = fwrite(&header, sizeof(header), 1, file) == 1
+		&& fwrite(cells, 1, (size_t)sizeX * sizeY, file) == (size_t)sizeX * sizeY
+		&& fwrite(padding, 1, MAP_FILE_PADDING, file) == MAP_FILE_PADDING;
+	fclose(file);
+	return ok;
+}
+
+/* ---- GenerateMap() ---------------------------------------
+* Parameters: 	size, fraction of interior cells that are walls, seed
+* Type: 		Public
+* Return:		newly allocated cells (with MAP_FILE_PADDING), caller frees
+* Description:
+*	Synthetic world for testing large maps: an enclosing wall plus
+*	randomly scattered wall cells of colors 1-4. Uses its own
+*	generator so the same seed gives the same map everywhere.
+* --------------------------------- end GenerateMap() ---- */
+uint8_t *GenerateMap(int sizeX, int sizeY, double density, unsigned int seed){
+	uint8_t *cells = calloc((size_t)sizeX * sizeY + MAP_FILE_PADDING, 1);
+	uint32_t state = seed * 2654435761u + 1;
+	uint32_t threshold = (uint32_t)(density * 4294967295.0);
+	if (cells == NULL) return NULL;
+	for (int x = 1; x < sizeX - 1; x++){
+		for (int y = 1; y < sizeY - 1; y++){
+			// xorshift32
+			state ^= state << 13;
+			state ^= state >> 17;
+			state ^= state << 5;
+			if (state < threshold) cells[(size_t)x * sizeY + y] = 1 + ((state >> 8) % 4);
+		}
+	}
+	EncloseMap(cells, sizeX, sizeY);
+	return cells;
+}
+
+#endif
@@ -0,0 +1,293 @@
+/**************************************************************
+* FILENAME:		MicroBench.c
+*
+* DESCRIPTION:	Times the renderer's inner pieces on their own: ray
+*				casting with every kernel, filling columns, and
+*				moving against walls.
+*
+* NOTES:		Needs no window: it only links SDL for its types and
+*				the performance counter. "make microbench" builds and
+*				runs it:
+*					./microbench [-repeats N] [-out results.csv]
+*				Maps are generated (MICRO_SIZES x MICRO_DENSITIES,
+*				fixed seed), and every map is looked at from the same
+*				MICRO_VIEWS random open cells, so runs on the same
+*				machine are comparable across commits. Each test is
+*				run MICRO_WARMUP times untimed, then -repeats times;
+*				it reports the mean and standard deviation over the
+*				repeats, and the fastest one:
+*					ray		ns per ray and DDA steps per ray, per
+*							kernel, grid (-grid) and resolution
+*					fill	FillColumn(), flat walls, pixels per ns
+*					texture	TextureColumn(), pixels per ns
+*					move	MovePlayer() (two cell lookups), ns per
+*							move, walking and turning at random
+*				Everything runs on one thread. -out appends one CSV
+*				row per result.
+**************************************************************/
+#include "SDL2/SDL.h"
+#include <stdio.h>
+#include <math.h>
+#include "const.h"
+#include "MapLoader.h"
+#include "SDL_Helpers.h"
+#include "Framebuffer.h"
+#include "RayKernel.h"
+#include "Textures.h"
+#include "Bench.h"
+#include "Movement.h"
+
+#define MICRO_VIEWS			8		// camera positions per map
+#define MICRO_WARMUP		2
+#define MICRO_REPEATS		10
+#define MICRO_MOVES			1000000	// MovePlayer() calls per repeat
+#define MICRO_SEED			1
+#define MICRO_MAX_REPEATS	1000
+
+const int microSizes[] = {256, 1024, 4096};
+const double microDensities[] = {0.01, 0.1, 0.3};
+const int microResolutions[][2] = {{320, 240}, {1920, 1080}};
+
+// Spread of one test's repeats
+typedef struct {
+	double mean;
+	double deviation;
+	double best;
+} MicroResult;
+
+int microRepeats = MICRO_REPEATS;
+FILE *microOut = NULL;
+
+/* xorshift32, like GenerateMap() */
+HIDDEN double MicroRandom(uint32_t *state){
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+	return *state / 4294967296.0;
+}
+
+/* Mean, standard deviation and minimum of count samples */
+HIDDEN MicroResult Summarise(const double *samples, int count){
+	MicroResult result = {0, 0, samples[0]};
+	for (int i = 0; i < count; i++){
+		result.mean += samples[i] / count;
+		if (samples[i] < result.best) result.best = samples[i];
+	}
+	for (int i = 0; i < count; i++) result.deviation += (samples[i] - result.mean) * (samples[i] - result.mean) / count;
+	result.deviation = sqrt(result.deviation);
+	return result;
+}
+
+/* Print a result, and append it to -out */
+HIDDEN void Report(const char *test, int size, double density, int width, int height, const char *variant, MicroResult result, const char *unit, double steps){
+	printf("%-8s %5i %5.2f %5ix%-5i %-13s %10.3f +- %7.3f (%4.1f%%) best %10.3f %s", test, size, density, width, height, variant,
+		result.mean, result.deviation, result.mean > 0 ? 100.0 * result.deviation / result.mean : 0, result.best, unit);
+	if (steps > 0) printf("  %.2f steps/ray", steps);
+	printf("\n");
+	if (microOut == NULL) return;
+	if (ftell(microOut) == 0) fprintf(microOut, "test,map_size,density,width,height,variant,repeats,mean,deviation,best,unit,steps_per_ray\n");
+	fprintf(microOut, "%s,%i,%.2f,%i,%i,%s,%i,%.4f,%.4f,%.4f,%s,%.2f\n", test, size, density, width, height, variant, microRepeats,
+		result.mean, result.deviation, result.best, unit, steps);
+}
+
+/* Make generated cells the world; FALSE if its occupancy plane doesn't fit */
+HIDDEN bool UseGeneratedMap(uint8_t *cells, int size){
+	FreeWorldMap();
+	world.owned = cells;
+	world.cells = cells;
+	world.sizeX = size;
+	world.sizeY = size;
+	FindSpawn(&world);
+	return BuildOccupancy();
+}
+
+/* ---- BenchRays() ---------------------------------------
+* Parameters: 	view origins, ray directions (width per view),
+*				hits to fill, map size and density for the report
+* Type: 		Public
+* Return:		None
+* Description:
+*	Casts every view with each kernel the CPU (and the map's
+*	distance field) supports, in both grids, as the renderer
+*	does: a whole screen row of adjacent rays at a time. The
+*	skipping kernel reads the distance field, so it is only
+*	timed once.
+* --------------------------------- end BenchRays() ---- */
+HIDDEN void BenchRays(const double *originX, const double *originY, const double *rayDirX, const double *rayDirY, ColumnHit *hits, int size, double density){
+	double samples[MICRO_MAX_REPEATS];
+	int rays = MICRO_VIEWS * SCREEN_WIDTH;
+
+	for (int variant = 0; variant < 2 * (KERNEL_SKIP + 1); variant++){
+		int kernel = variant / 2;
+		char name[32];
+		rayGrid = SelectRayGrid(variant % 2 ? GRID_MORTON : GRID_CELLS);
+		if (SelectRayKernel(kernel) != kernel || (variant % 2 && (kernel == KERNEL_SKIP || rayGrid != GRID_MORTON))) continue;
+		rayKernel = kernel;
+		if (kernel == KERNEL_SKIP) snprintf(name, sizeof(name), "%s", rayKernelNames[kernel]);
+		else snprintf(name, sizeof(name), "%s/%s", rayKernelNames[kernel], rayGridNames[rayGrid]);
+		for (int repeat = -MICRO_WARMUP; repeat < microRepeats; repeat++){
+			Uint64 start = SDL_GetPerformanceCounter();
+			for (int view = 0; view < MICRO_VIEWS; view++){
+				size_t first = (size_t)view * SCREEN_WIDTH;
+				CastRays(originX[view], originY[view], rayDirX + first, rayDirY + first, SCREEN_WIDTH, hits + first);
+			}
+			if (repeat >= 0) samples[repeat] = ElapsedMs(start, SDL_GetPerformanceCounter()) * 1e6 / rays;
+		}
+		double steps = 0;
+		for (int i = 0; i < rays; i++) steps += hits[i].steps;
+		Report("ray", size, density, SCREEN_WIDTH, SCREEN_HEIGHT, name, Summarise(samples, microRepeats), "ns/ray", steps / rays);
+	}
+}
+
+/* ---- BenchColumns() ---------------------------------------
+* Parameters: 	view origins, ray directions, their hits, map size
+*				and density for the report
+* Type: 		Public
+* Return:		None
+* Description:
+*	Draws every view's columns into the framebuffer, flat and
+*	textured, clearing above and below the walls the way frames
+*	without floors do, so each view writes every pixel once.
+* --------------------------------- end BenchColumns() ---- */
+HIDDEN void BenchColumns(const double *originX, const double *originY, const double *rayDirX, const double *rayDirY, ColumnHit *hits, int size, double density){
+	double samples[MICRO_MAX_REPEATS];
+	double pixels = (double)MICRO_VIEWS * SCREEN_WIDTH * SCREEN_HEIGHT;
+
+	for (int textured = 0; textured <= 1; textured++){
+		for (int repeat = -MICRO_WARMUP; repeat < microRepeats; repeat++){
+			Uint64 start = SDL_GetPerformanceCounter();
+			for (int i = 0; i < MICRO_VIEWS * SCREEN_WIDTH; i++){
+				int x = i % SCREEN_WIDTH;
+				int lineHeight = (int)(SCREEN_HEIGHT / hits[i].perpWallDist);
+				int drawStart = SDL_max(-lineHeight / 2 + SCREEN_HEIGHT / 2, 0);
+				int drawEnd = SDL_min(lineHeight / 2 + SCREEN_HEIGHT / 2, SCREEN_HEIGHT - 1);
+				if (textured){
+					int texture = (WORLD_CELL(hits[i].mapX, hits[i].mapY) - 1) % textureCount;
+					TextureColumn(x, drawStart, drawEnd, lineHeight, TextureStrip(texture, hits[i].side, hits[i].texX));
+				}
+				else{
+					FillColumn(x, drawStart, drawEnd, WallColor(WallColorNumber(WORLD_CELL(hits[i].mapX, hits[i].mapY)) + hits[i].side * 0.5));
+				}
+			}
+			if (repeat >= 0) samples[repeat] = pixels / (ElapsedMs(start, SDL_GetPerformanceCounter()) * 1e6);
+		}
+		Report(textured ? "texture" : "fill", size, density, SCREEN_WIDTH, SCREEN_HEIGHT, "scalar", Summarise(samples, microRepeats), "pixels/ns", 0);
+	}
+}
+
+/* ---- BenchMoves() ---------------------------------------
+* Parameters: 	map size and density for the report
+* Type: 		Public
+* Return:		None
+* Description:
+*	Walks from the spawn point in short steps, turning a little
+*	at random each time and sliding along whatever it runs into,
+*	like a player holding forward and steering.
+* --------------------------------- end BenchMoves() ---- */
+HIDDEN void BenchMoves(int size, double density){
+	double samples[MICRO_MAX_REPEATS];
+	double turns[256];
+	uint32_t random = MICRO_SEED;
+	for (int i = 0; i < 256; i++) turns[i] = (MicroRandom(&random) - 0.5) * 0.2;
+
+	for (int repeat = -MICRO_WARMUP; repeat < microRepeats; repeat++){
+		CameraState state = {world.spawnX + 0.5, world.spawnY + 0.5, -1, 0, 0, 0.66};
+		Uint64 start = SDL_GetPerformanceCounter();
+		for (int move = 0; move < MICRO_MOVES; move++){
+			MovePlayer(&state, state.posX + state.dirX * 0.05, state.posY + state.dirY * 0.05);
+			TurnPlayer(&state, turns[move & 255]);
+		}
+		if (repeat >= 0) samples[repeat] = ElapsedMs(start, SDL_GetPerformanceCounter()) * 1e6 / MICRO_MOVES;
+		if (state.posX < 0) printf("%s\n", "Walked off the map"); // keeps the walk from being optimised away
+	}
+	Report("move", size, density, 0, 0, "scalar", Summarise(samples, microRepeats), "ns/move", 0);
+}
+
+int main(int argc, char *argv[]){
+	/* Argument Variables */
+	for (int i = 1; i < argc; i++){
+		if (!strcmp(argv[i], "-repeats") && (i+1) < argc){
+			microRepeats = atoi(argv[i+1]);
+			if (microRepeats < 1) microRepeats = 1;
+			if (microRepeats > MICRO_MAX_REPEATS) microRepeats = MICRO_MAX_REPEATS;
+		}
+		else if (!strcmp(argv[i], "-out") && (i+1) < argc){
+			microOut = fopen(argv[i+1], "a");
+			if (microOut == NULL) printf("%s%s\n", "Could not write ", argv[i+1]);
+		}
+	}
+	WINDOW_WIDTH = 0;
+	WINDOW_HEIGHT = 0;
+	for (int r = 0; r < (int)(sizeof(microResolutions) / sizeof(microResolutions[0])); r++){
+		if (microResolutions[r][0] > WINDOW_WIDTH) WINDOW_WIDTH = microResolutions[r][0];
+		if (microResolutions[r][1] > WINDOW_HEIGHT) WINDOW_HEIGHT = microResolutions[r][1];
+	}
+
+	// Buffers for the largest resolution; no window or texture is made
+	frameBuffer = malloc(sizeof(Uint32) * WINDOW_WIDTH * WINDOW_HEIGHT);
+	double *originX = malloc(sizeof(double) * MICRO_VIEWS);
+	double *originY = malloc(sizeof(double) * MICRO_VIEWS);
+	double *rayDirX = malloc(sizeof(double) * MICRO_VIEWS * WINDOW_WIDTH);
+	double *rayDirY = malloc(sizeof(double) * MICRO_VIEWS * WINDOW_WIDTH);
+	ColumnHit *hits = malloc(sizeof(ColumnHit) * MICRO_VIEWS * WINDOW_WIDTH);
+	if (frameBuffer == NULL || originX == NULL || originY == NULL || rayDirX == NULL || rayDirY == NULL || hits == NULL || !GenerateTextures()){
+		printf("%s\n", "Out of memory");
+		return EXIT_FAILURE;
+	}
+	InitRayPrecision();
+	printf("%s%s%s%i%s\n", "Ray precision: ", rayPrecisionNames[RAY_PRECISION], ", ", microRepeats, " repeats");
+
+	for (int s = 0; s < (int)(sizeof(microSizes) / sizeof(microSizes[0])); s++){
+		for (int d = 0; d < (int)(sizeof(microDensities) / sizeof(microDensities[0])); d++){
+			int size = microSizes[s];
+			double density = microDensities[d];
+			uint8_t *cells = GenerateMap(size, size, density, MICRO_SEED);
+			if (cells == NULL || !UseGeneratedMap(cells, size)){
+				printf("%s\n", "Out of memory for the map");
+				return EXIT_FAILURE;
+			}
+			if (RAY_PRECISION == RAY_DOUBLE && !BuildDistanceField()) printf("%s\n", "Out of memory for the distance field, not timing skipping");
+
+			// The same views of every map: random open cells, random directions
+			uint32_t random = MICRO_SEED;
+			double angle[MICRO_VIEWS];
+			for (int view = 0; view < MICRO_VIEWS; view++){
+				do{
+					originX[view] = 1 + MicroRandom(&random) * (size - 2);
+					originY[view] = 1 + MicroRandom(&random) * (size - 2);
+				} while (WORLD_CELL((int)originX[view], (int)originY[view]) != EMPTYSPACE);
+				angle[view] = MicroRandom(&random) * 2 * M_PI;
+			}
+
+			for (int r = 0; r < (int)(sizeof(microResolutions) / sizeof(microResolutions[0])); r++){
+				SCREEN_WIDTH = microResolutions[r][0];
+				SCREEN_HEIGHT = microResolutions[r][1];
+				for (int view = 0; view < MICRO_VIEWS; view++){
+					CameraState camera = {originX[view], originY[view], cos(angle[view]), sin(angle[view]), -0.66 * sin(angle[view]), 0.66 * cos(angle[view])};
+					for (int x = 0; x < SCREEN_WIDTH; x++){
+						double cameraX = 2 * x / ((double)(SCREEN_WIDTH) - 1);
+						rayDirX[(size_t)view * SCREEN_WIDTH + x] = camera.dirX + camera.planeX * cameraX;
+						rayDirY[(size_t)view * SCREEN_WIDTH + x] = camera.dirY + camera.planeY * cameraX;
+					}
+				}
+				BenchRays(originX, originY, rayDirX, rayDirY, hits, size, density);
+				for (int i = 0; i < MICRO_VIEWS * SCREEN_WIDTH; i++){
+					hits[i].texX = TextureX(originX[i / SCREEN_WIDTH], originY[i / SCREEN_WIDTH], rayDirX[i], rayDirY[i], &hits[i]);
+				}
+				BenchColumns(originX, originY, rayDirX, rayDirY, hits, size, density);
+			}
+			BenchMoves(size, density);
+		}
+	}
+
+	if (microOut != NULL) fclose(microOut);
+	FreeWorldMap();
+	FreeTextures();
+	free(frameBuffer);
+	free(originX);
+	free(originY);
+	free(rayDirX);
+	free(rayDirY);
+	free(hits);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,33 @@
+/**************************************************************
+* FILENAME:		Movement.h
+*
+* DESCRIPTION:	Player movement against the world grid: walking
+*				with wall collision, and turning.
+*
+* NOTES:		StepPlayer() (SDL_Render_Main.c) applies these for
+*				the keys held down; the microbenchmarks time them on
+*				their own. Like rays, movement relies on the map being
+*				enclosed and never checks bounds. It reads the
+*				occupancy plane with atomic loads, since the player
+*				thread moves while map edits are being applied.
+**************************************************************/
+
+/* Move to (newXPos, newYPos) if we can, sliding along walls */
+HIDDEN void MovePlayer(CameraState *state, double newXPos, double newYPos){
+	if(!SolidBitAtomic(MortonIndex((int)(newXPos), (int)(state->posY)))){
+		state->posX = newXPos;
+	}
+	if(!SolidBitAtomic(MortonIndex((int)(state->posX), (int)(newYPos)))){
+		state->posY = newYPos;
+	}
+}
+
+/* Rotate the view direction and camera plane by angle radians */
+HIDDEN void TurnPlayer(CameraState *state, double angle){
+	double oldDirX = state->dirX;
+	state->dirX = state->dirX * cos(angle) - state->dirY * sin(angle);
+	state->dirY = oldDirX * sin(angle) + state->dirY * cos(angle);
+	double oldPlaneX = state->planeX;
+	state->planeX = state->planeX * cos(angle) - state->planeY * sin(angle);
+	state->planeY = oldPlaneX * sin(angle) + state->planeY * cos(angle);
+}
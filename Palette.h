@@ -0,0 +1,151 @@
+/**************************************************************
+* FILENAME:		Palette.h
+*
+* DESCRIPTION:	8-bit indexed framebuffer with distance shading.
+*
+* NOTES:		-framebuffer 8 draws walls as one byte per pixel:
+*				a palette index looked up from the cell value, the
+*				side that was hit and how far away the wall is
+*				(SHADE_BANDS steps fading towards black at
+*				FOG_DISTANCE cells). Columns write a quarter of the
+*				bytes of the 32-bit framebuffer; the finished frame
+*				is expanded to ARGB8888 through the palette, in
+*				bands of rows over the worker pool, just before it
+*				is uploaded. Walls are always flat in this mode.
+**************************************************************/
+
+#define PALETTE_SIZE		256
+#define PALETTE_BLACK		0		// index 0 is the background
+#define WALL_COLORS			5		// wall color numbers 1-5, see WallColorNumber()
+#define SHADE_BANDS			16
+#define FOG_DISTANCE		16.0	// cells; walls this far away or more get the darkest band
+#define FOG_BRIGHTNESS		0.15	// brightness of the darkest band
+#define EXPAND_ROWS			16		// rows per ParallelFor() tile when expanding
+
+// The AVX2 expansion is built on any x86 target, whatever the ray kernel's precision
+#if defined(__x86_64__) || defined(__i386__)
+#define PALETTE_X86
+#include <immintrin.h>		// AVX2 (only used in ExpandIndexedAVX2(), built with target("avx2"))
+#endif
+
+// Indexed framebuffer globals
+Uint8 *indexBuffer = NULL;		// SCREEN_WIDTH * SCREEN_HEIGHT palette indices, row-major (room for the whole window)
+Uint32 palette[PALETTE_SIZE];	// ARGB8888 color of every index
+Uint8 shadeTable[256][2][SHADE_BANDS];	// [cell value][side][distance band] -> palette index
+
+/* Color scaled to a distance band: full brightness down to FOG_BRIGHTNESS */
+Uint32 ShadeColor(Uint32 color, int band){
+	double brightness = 1.0 - (1.0 - FOG_BRIGHTNESS) * band / (SHADE_BANDS - 1);
+	return COLOR_BLACK
+		| (Uint32)(((color >> 16) & 0xFF) * brightness) << 16
+		| (Uint32)(((color >> 8) & 0xFF) * brightness) << 8
+		| (Uint32)((color & 0xFF) * brightness);
+}
+
+/* ---- CreateIndexedBuffer() ---------------------------------------
+* Parameters: 	None
+* Type: 		Public
+* Return:		TRUE on success
+* Description:
+*	Allocates the index buffer (frameBuffer still receives the
+*	expanded frame) and fills the palette and shading table. Each
+*	wall color and side gets SHADE_BANDS palette entries, from full
+*	brightness down to FOG_BRIGHTNESS; the table maps every cell
+*	value straight to one of them, so drawing is a single lookup.
+* --------------------------------- end CreateIndexedBuffer() ---- */
+bool CreateIndexedBuffer(){
+	indexBuffer = malloc(WINDOW_WIDTH * WINDOW_HEIGHT);
+	if (indexBuffer == NULL){
+		printf("%s\n", "Could not create indexed framebuffer");
+		return FALSE;
+	}
+
+	for (int i = 0; i < PALETTE_SIZE; i++) palette[i] = COLOR_BLACK;
+	for (int color = 1; color <= WALL_COLORS; color++){
+		for (int side = 0; side < 2; side++){
+			Uint32 base = WallColor(color + side * 0.5);
+			for (int band = 0; band < SHADE_BANDS; band++){
+				palette[1 + ((color - 1) * 2 + side) * SHADE_BANDS + band] = ShadeColor(base, band);
+			}
+		}
+	}
+	for (int cell = 0; cell < 256; cell++){
+		for (int side = 0; side < 2; side++){
+			for (int band = 0; band < SHADE_BANDS; band++){
+				shadeTable[cell][side][band] = 1 + ((WallColorNumber(cell) - 1) * 2 + side) * SHADE_BANDS + band;
+			}
+		}
+	}
+	return TRUE;
+}
+
+void DestroyIndexedBuffer(){
+	free(indexBuffer);
+	indexBuffer = NULL;
+}
+
+/* Distance band of a wall perpWallDist cells away */
+static inline int ShadeBand(double perpWallDist){
+	int band = (int)(perpWallDist * (SHADE_BANDS / FOG_DISTANCE));
+	return band < SHADE_BANDS - 1 ? band : SHADE_BANDS - 1;
+}
+
+/* FillColumn() for the index buffer */
+void FillIndexedColumn(int x, int y1, int y2, Uint8 index){
+	Uint8 *pixel = indexBuffer + x;
+	int y = 0;
+
+	if (y1 < 0) y1 = 0; //clip
+	if (y2 >= SCREEN_HEIGHT) y2 = SCREEN_HEIGHT - 1; //clip
+	if (!clearAroundWalls){
+		y = y1;
+		pixel += (size_t)y1 * SCREEN_WIDTH;
+	}
+
+	for (; y < y1; y++, pixel += SCREEN_WIDTH) *pixel = PALETTE_BLACK;
+	for (; y <= y2; y++, pixel += SCREEN_WIDTH) *pixel = index;
+	for (; clearAroundWalls && y < SCREEN_HEIGHT; y++, pixel += SCREEN_WIDTH) *pixel = PALETTE_BLACK;
+}
+
+#ifdef PALETTE_X86
+/* Palette lookup for count pixels, eight at a time with AVX2 gathers */
+__attribute__((target("avx2")))
+void ExpandIndexedAVX2(Uint32 *out, const Uint8 *in, int count){
+	int i = 0;
+	for (; i + 8 <= count; i += 8){
+		__m256i index = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(in + i)));
+		_mm256_storeu_si256((__m256i *)(out + i), _mm256_i32gather_epi32((const int *)palette, index, 4));
+	}
+	for (; i < count; i++) out[i] = palette[in[i]];
+}
+#endif
+
+void ExpandIndexedScalar(Uint32 *out, const Uint8 *in, int count){
+	for (int i = 0; i < count; i++) out[i] = palette[in[i]];
+}
+
+/* ---- ExpandRows() ---------------------------------------
+* Parameters: 	band - index of a group of EXPAND_ROWS rows
+* Type: 		Public
+* Return:		None
+* Description:
+*	Converts one band of the index buffer into frameBuffer, ready
+*	for PresentFramebuffer(). Bands are independent, so they are
+*	spread over the worker pool like column tiles.
+* --------------------------------- end ExpandRows() ---- */
+void ExpandRows(int band, void *unused){
+	int first = band * EXPAND_ROWS;
+	int rows = SCREEN_HEIGHT - first;
+	if (rows > EXPAND_ROWS) rows = EXPAND_ROWS;
+
+	size_t offset = (size_t)first * SCREEN_WIDTH;
+#ifdef PALETTE_X86
+	static int avx2 = -1;
+	if (avx2 < 0) avx2 = __builtin_cpu_supports("avx2") ? 1 : 0; // same answer on every thread
+	if (avx2){
+		ExpandIndexedAVX2(frameBuffer + offset, indexBuffer + offset, rows * SCREEN_WIDTH);
+		return;
+	}
+#endif
+	ExpandIndexedScalar(frameBuffer + offset, indexBuffer + offset, rows * SCREEN_WIDTH);
+}
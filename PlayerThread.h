@@ -0,0 +1,158 @@
+/**************************************************************
+* FILENAME:		PlayerThread.h
+*
+* DESCRIPTION:	Player simulation on its own thread, handing camera
+*				snapshots to the renderer through a triple buffer.
+*
+* NOTES:		The player moves in steps of exactly SIM_STEP seconds
+*				on a dedicated thread, whatever the renderer is doing.
+*				After every step it publishes a snapshot (the last two
+*				states and when the newer one was due) into one of
+*				three slots and swaps that slot in with a single
+*				atomic exchange; the renderer swaps out the newest
+*				slot the same way. Neither side ever waits for the
+*				other or sees a half-written snapshot.
+*				SDL only delivers events on the thread that created
+*				the window, so the main thread still polls them once
+*				per frame and publishes the keys held down as a bit
+*				mask (heldKeys), which the simulation reads.
+*				If the thread can't be started, the main thread runs
+*				the due steps itself before each frame.
+**************************************************************/
+
+#define SIM_RATE			120		// simulation steps per second
+#define SIM_STEP			(1.0 / SIM_RATE)
+#define MAX_SIM_LAG			0.25	// seconds; after a longer stall the lost time is dropped
+#define SNAPSHOT_FRESH		4		// set in snapshotMiddle when it holds a snapshot not read yet
+
+// heldKeys bits
+#define KEY_FORWARD			1
+#define KEY_BACK			2
+#define KEY_TURN_LEFT		4
+#define KEY_TURN_RIGHT		8
+#define KEY_SPRINT			16
+
+// Advances a camera state by dt seconds of movement for the keys held
+typedef void (*SimStep)(CameraState *state, double dt, int keys);
+
+// What the renderer needs to interpolate: the last two steps and when the newer one was due
+typedef struct {
+	CameraState previous;
+	CameraState current;
+	Uint64 time;			// performance counter value of current
+} PlayerSnapshot;
+
+// Player thread globals
+int heldKeys = 0;					// written by the main thread, read by the simulation
+PlayerSnapshot snapshots[3];
+int snapshotBack = 0;				// slot the simulation writes next (simulation only)
+int snapshotMiddle = 1;				// last published slot, plus SNAPSHOT_FRESH
+int snapshotFront = 2;				// slot the renderer reads (renderer only)
+SimStep simStep;
+CameraState simPrevious;			// simulation only
+CameraState simCurrent;
+Uint64 simNext = 0;					// when the next step is due
+pthread_t playerThread;
+bool playerThreadRunning = FALSE;
+int playerThreadQuit = FALSE;
+
+/* Publish the latest two states as the newest snapshot */
+HIDDEN void PublishSnapshot(Uint64 time){
+	PlayerSnapshot *snapshot = &snapshots[snapshotBack];
+	snapshot->previous = simPrevious;
+	snapshot->current = simCurrent;
+	snapshot->time = time;
+	snapshotBack = __atomic_exchange_n(&snapshotMiddle, snapshotBack | SNAPSHOT_FRESH, __ATOMIC_ACQ_REL) & 3;
+}
+
+/* Run every step that is due; returns how long until the next one, in counter ticks */
+HIDDEN Uint64 RunDueSteps(){
+	Uint64 period = SDL_GetPerformanceFrequency() / SIM_RATE;
+	Uint64 now = SDL_GetPerformanceCounter();
+
+	if (now > simNext + (Uint64)(MAX_SIM_LAG * SIM_RATE) * period) simNext = now;
+	while (simNext <= now){
+		simPrevious = simCurrent;
+		simStep(&simCurrent, SIM_STEP, __atomic_load_n(&heldKeys, __ATOMIC_RELAXED));
+		PublishSnapshot(simNext);
+		simNext += period;
+	}
+	return simNext - now;
+}
+
+HIDDEN void *PlayerThreadMain(void *unused){
+	while (!__atomic_load_n(&playerThreadQuit, __ATOMIC_ACQUIRE)){
+		Uint64 wait = RunDueSteps();
+		SDL_Delay((Uint32)(wait * 1000 / SDL_GetPerformanceFrequency())); // a late wake-up only delays publishing, steps stay on schedule
+	}
+	return NULL;
+}
+
+/* ---- StartPlayerThread() ---------------------------------------
+* Parameters: 	step function, positionInfo with the starting camera
+* Type: 		Public
+* Return:		TRUE if the simulation runs on its own thread
+* Description:
+*	Fills every snapshot slot with the starting camera and starts
+*	stepping from now.
+* --------------------------------- end StartPlayerThread() ---- */
+bool StartPlayerThread(SimStep step, const double *positionInfo){
+	CameraState start = {positionInfo[0], positionInfo[1], positionInfo[2], positionInfo[3], positionInfo[4], positionInfo[5]};
+
+	simStep = step;
+	simPrevious = start;
+	simCurrent = start;
+	simNext = SDL_GetPerformanceCounter();
+	for (int i = 0; i < 3; i++){
+		snapshots[i].previous = start;
+		snapshots[i].current = start;
+		snapshots[i].time = simNext;
+	}
+	playerThreadQuit = FALSE;
+	playerThreadRunning = pthread_create(&playerThread, NULL, PlayerThreadMain, NULL) == 0;
+	if (!playerThreadRunning) printf("%s\n", "Could not start the player thread, simulating between frames");
+	return playerThreadRunning;
+}
+
+void StopPlayerThread(){
+	if (!playerThreadRunning) return;
+	__atomic_store_n(&playerThreadQuit, TRUE, __ATOMIC_RELEASE);
+	pthread_join(playerThread, NULL);
+	playerThreadRunning = FALSE;
+}
+
+/* Called by the main thread after polling events */
+void PublishHeldKeys(int keys){
+	__atomic_store_n(&heldKeys, keys, __ATOMIC_RELAXED);
+}
+
+/* ---- LatestCamera() ---------------------------------------
+* Parameters: 	positionInfo to receive the camera
+* Type: 		Public
+* Return:		None
+* Description:
+*	Takes the newest published snapshot, if there is one the
+*	renderer has not seen, and writes the camera interpolated
+*	between its two states by how far real time has moved past the
+*	newer one. The view lags the simulation by at most one step.
+* --------------------------------- end LatestCamera() ---- */
+void LatestCamera(double *positionInfo){
+	if (!playerThreadRunning) RunDueSteps();
+	if (__atomic_load_n(&snapshotMiddle, __ATOMIC_ACQUIRE) & SNAPSHOT_FRESH){
+		snapshotFront = __atomic_exchange_n(&snapshotMiddle, snapshotFront, __ATOMIC_ACQ_REL) & 3;
+	}
+	const PlayerSnapshot *snapshot = &snapshots[snapshotFront];
+
+	Uint64 now = SDL_GetPerformanceCounter();
+	double alpha = now > snapshot->time ? (double)(now - snapshot->time) * SIM_RATE / (double)SDL_GetPerformanceFrequency() : 0;
+	if (alpha > 1) alpha = 1;
+
+	const CameraState *a = &snapshot->previous;
+	const CameraState *b = &snapshot->current;
+	positionInfo[0] = a->posX + (b->posX - a->posX) * alpha;
+	positionInfo[1] = a->posY + (b->posY - a->posY) * alpha;
+	positionInfo[2] = a->dirX + (b->dirX - a->dirX) * alpha;
+	positionInfo[3] = a->dirY + (b->dirY - a->dirY) * alpha;
+	positionInfo[4] = a->planeX + (b->planeX - a->planeX) * alpha;
+	positionInfo[5] = a->planeY + (b->planeY - a->planeY) * alpha;
+}
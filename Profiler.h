@@ -0,0 +1,201 @@
+/**************************************************************
+* FILENAME:		Profiler.h
+*
+* DESCRIPTION:	Per-stage frame timing overlay and telemetry.
+*
+* NOTES:		Every frame's stage timings (input, cast, draw,
+*				overlay, present) go into a ring of the last
+*				PROFILE_HISTORY frames. -showfps 1 draws them as a
+*				rolling graph, one bar per frame with a segment per
+*				stage, under a line of text with the latest numbers.
+*				The text comes from a glyph atlas rendered once at
+*				startup, so the overlay costs a few SDL_RenderCopy()
+*				and SDL_RenderFillRect() calls per frame.
+*				-telemetry file.csv writes the same counters for
+*				every frame, one row each, for offline analysis.
+**************************************************************/
+
+#define PROFILE_HISTORY		240		// frames kept for the graph (one pixel column each)
+#define PROFILE_GRAPH_HEIGHT	100	// pixels
+#define PROFILE_GRAPH_MS	33.3	// frame time at the top of the graph
+#define PROFILE_STAGES		5
+#define GLYPH_FIRST			32		// the atlas covers printable ASCII
+#define GLYPH_LAST			126
+#define OVERLAY_FONT_SIZE	16
+
+// Profiler globals
+FrameTiming profileHistory[PROFILE_HISTORY];
+int profileFrames = 0;			// frames recorded so far
+FILE *telemetryFile = NULL;		// set by -telemetry
+SDL_Texture *glyphAtlas = NULL;
+SDL_Rect glyphRects[GLYPH_LAST - GLYPH_FIRST + 1];
+int glyphHeight = 0;
+
+// Stage order and colors in the graph, bottom to top
+const char *profileStageNames[PROFILE_STAGES] = {"input", "cast", "draw", "overlay", "present"};
+const SDL_Color profileStageColors[PROFILE_STAGES] = {
+	{200, 200, 200, 255}, {255, 80, 80, 255}, {80, 200, 80, 255}, {220, 200, 60, 255}, {80, 140, 255, 255}};
+
+HIDDEN double StageTime(const FrameTiming *timing, int stage){
+	switch(stage){
+		case 0: return timing->input;
+		case 1: return timing->cast;
+		case 2: return timing->draw;
+		case 3: return timing->overlay;
+		default: return timing->present;
+	}
+}
+
+/* ---- CreateGlyphAtlas() ---------------------------------------
+* Parameters: 	path of a TrueType font
+* Type: 		Public
+* Return:		TRUE on success
+* Description:
+*	Renders every printable character once, as one line of text,
+*	into a texture and remembers where each glyph sits in it.
+*	Positions come from the widths of growing prefixes of that
+*	line, so they match what TTF_RenderText drew.
+* --------------------------------- end CreateGlyphAtlas() ---- */
+bool CreateGlyphAtlas(const char *fontFile){
+	char glyphs[GLYPH_LAST - GLYPH_FIRST + 2];
+	SDL_Color white = {255, 255, 255, 255};
+	TTF_Font *font = TTF_OpenFont(fontFile, OVERLAY_FONT_SIZE);
+
+	if (font == NULL){
+		printf("%s%s%s%s\n", "Could not open font ", fontFile, ": ", SDL_GetError());
+		return FALSE;
+	}
+	for (int c = GLYPH_FIRST; c <= GLYPH_LAST; c++) glyphs[c - GLYPH_FIRST] = (char)c;
+	glyphs[GLYPH_LAST - GLYPH_FIRST + 1] = '\0';
+
+	SDL_Surface *surface = TTF_RenderText_Blended(font, glyphs, white);
+	if (surface != NULL){
+		int left = 0;
+		for (int i = 0; i <= GLYPH_LAST - GLYPH_FIRST; i++){
+			char saved = glyphs[i + 1];
+			int right, height;
+			glyphs[i + 1] = '\0';
+			TTF_SizeText(font, glyphs, &right, &height);
+			glyphs[i + 1] = saved;
+			SDL_Rect rect = {left, 0, right - left, surface->h};
+			glyphRects[i] = rect;
+			left = right;
+		}
+		glyphHeight = surface->h;
+		glyphAtlas = SDL_CreateTextureFromSurface(renderer, surface);
+		SDL_FreeSurface(surface);
+	}
+	TTF_CloseFont(font);
+	return glyphAtlas != NULL;
+}
+
+void DestroyGlyphAtlas(){
+	if (glyphAtlas != NULL) SDL_DestroyTexture(glyphAtlas);
+	glyphAtlas = NULL;
+}
+
+/* Draw text from the glyph atlas with its top left corner at (x, y); returns the x it ended at */
+int DrawText(const char *text, int x, int y){
+	for (; *text != '\0'; text++){
+		int c = (unsigned char)*text;
+		if (c < GLYPH_FIRST || c > GLYPH_LAST) c = '?';
+		SDL_Rect source = glyphRects[c - GLYPH_FIRST];
+		SDL_Rect target = {x, y, source.w, source.h};
+		SDL_RenderCopy(renderer, glyphAtlas, &source, &target);
+		x += source.w;
+	}
+	return x;
+}
+
+/* Open the -telemetry file and write its header */
+bool OpenTelemetry(const char *file){
+	telemetryFile = fopen(file, "w");
+	if (telemetryFile == NULL){
+		printf("%s%s\n", "Could not write telemetry to ", file);
+		return FALSE;
+	}
+	fprintf(telemetryFile, "frame,total_ms,input_ms,cast_ms,draw_ms,overlay_ms,present_ms,steps_per_ray,cached_pct,scale\n");
+	return TRUE;
+}
+
+void CloseTelemetry(){
+	if (telemetryFile != NULL) fclose(telemetryFile);
+	telemetryFile = NULL;
+}
+
+/* Add the finished frame's timings to the history and the telemetry file */
+void RecordFrameTiming(const FrameTiming *timing){
+	profileHistory[profileFrames % PROFILE_HISTORY] = *timing;
+	if (telemetryFile != NULL){
+		fprintf(telemetryFile, "%i,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.2f,%.1f,%.3f\n", profileFrames,
+			timing->total, timing->input, timing->cast, timing->draw, timing->overlay, timing->present, timing->steps, 100.0 * timing->cached, timing->scale);
+	}
+	profileFrames++;
+}
+
+/* ---- DrawProfilerOverlay() ---------------------------------------
+* Parameters: 	None
+* Type: 		Public
+* Return:		None
+* Description:
+*	Draws the last recorded frame's stage times as text and the
+*	history as a graph in the top left corner, on top of whatever
+*	the renderer holds. Bars grow to the right as frames arrive and
+*	then scroll; a line marks PROFILE_GRAPH_MS / 2 (60 fps).
+* --------------------------------- end DrawProfilerOverlay() ---- */
+void DrawProfilerOverlay(){
+	int frames = profileFrames < PROFILE_HISTORY ? profileFrames : PROFILE_HISTORY;
+	int top = glyphAtlas != NULL ? glyphHeight * 2 + 4 : 0;
+	double scale = PROFILE_GRAPH_HEIGHT / PROFILE_GRAPH_MS;
+
+	if (frames == 0) return;
+	const FrameTiming *last = &profileHistory[(profileFrames - 1) % PROFILE_HISTORY];
+
+	// Backdrop so the graph stays readable over bright walls
+	SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+	SDL_SetRenderDrawColor(renderer, 0, 0, 0, 160);
+	SDL_Rect backdrop = {0, 0, PROFILE_HISTORY, top + PROFILE_GRAPH_HEIGHT};
+	SDL_RenderFillRect(renderer, &backdrop);
+	SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_NONE);
+
+	if (glyphAtlas != NULL){
+		char line[64];
+		int x = 2;
+		sprintf(line, "%.2f ms (%.0f fps)", last->total, last->total > 0 ? 1000.0 / last->total : 0);
+		x = DrawText(line, x, 2);
+		if (last->scale < 1){
+			sprintf(line, "  at %.0f%% resolution", 100.0 * last->scale);
+			DrawText(line, x, 2);
+		}
+		x = 2;
+		for (int stage = 0; stage < PROFILE_STAGES; stage++){
+			SDL_Color color = profileStageColors[stage];
+			SDL_SetTextureColorMod(glyphAtlas, color.r, color.g, color.b);
+			sprintf(line, "%s %.2f  ", profileStageNames[stage], StageTime(last, stage));
+			x = DrawText(line, x, glyphHeight + 2);
+		}
+		SDL_SetTextureColorMod(glyphAtlas, 255, 255, 255);
+	}
+
+	// One pixel column per frame, oldest on the left, stages stacked bottom to top
+	for (int stage = 0; stage < PROFILE_STAGES; stage++){
+		SDL_Rect bars[PROFILE_HISTORY];
+		int count = 0;
+		for (int i = 0; i < frames; i++){
+			const FrameTiming *timing = &profileHistory[(profileFrames - frames + i) % PROFILE_HISTORY];
+			double below = 0;
+			for (int s = 0; s < stage; s++) below += StageTime(timing, s);
+			int y0 = (int)(below * scale);
+			int y1 = (int)((below + StageTime(timing, stage)) * scale);
+			if (y1 > PROFILE_GRAPH_HEIGHT) y1 = PROFILE_GRAPH_HEIGHT;
+			if (y1 <= y0) continue;
+			SDL_Rect bar = {i, top + PROFILE_GRAPH_HEIGHT - y1, 1, y1 - y0};
+			bars[count++] = bar;
+		}
+		SDL_Color color = profileStageColors[stage];
+		SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, 255);
+		SDL_RenderFillRects(renderer, bars, count);
+	}
+	SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+	SDL_RenderDrawLine(renderer, 0, top + PROFILE_GRAPH_HEIGHT / 2, PROFILE_HISTORY - 1, top + PROFILE_GRAPH_HEIGHT / 2);
+}
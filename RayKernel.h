@@ -0,0 +1,740 @@
+/**************************************************************
+* FILENAME:		RayKernel.h
+*
+* DESCRIPTION:	Digital Differential Analysis (DDA) ray traversal
+*				through the world grid: a scalar reference, SSE2/AVX2
+*				ray-packet kernels that step 4 or 8 adjacent rays
+*				together, and a scalar kernel that jumps over empty
+*				space using the map's distance field.
+*
+* NOTES:		sideDist after n steps is always computed as
+*				sideDist0 + n * deltaDist (SideDistAfter()) rather than
+*				by repeated addition, so any step count can be reached
+*				directly and every kernel gets the same bits.
+*				Packets keep one lane per ray. Every step, each
+*				still-active lane takes the same X-or-Y decision and
+*				the same double arithmetic as the scalar loop, using
+*				masks instead of a branch, so each lane ends on
+*				exactly the same cell/side/perpWallDist as CastRay().
+*				Lanes that hit a wall are masked off; the packet ends
+*				when every lane has hit.
+*				Whether a packet beats the scalar loop depends on the
+*				CPU (gather speed) and on how far apart neighbouring
+*				rays end up, so the kernel is picked at runtime by
+*				timing each one the CPU supports (see -simd).
+*				The scalar kernel can be built in float or 16.16
+*				fixed point instead of double (-DRAY_PRECISION, see
+*				the makefile) for CPUs with slow double math such as
+*				the Pi. Those builds only have the scalar kernel;
+*				CastRayDouble() stays as the reference they are
+*				checked against (-checkprecision).
+*				Double kernels test for walls in one of two grids
+*				(-grid): the byte cells, or the world's occupancy
+*				bits (GRID_MORTON, see MapLoader.h), which they step
+*				through with MortonStep() alongside mapX/mapY. Each
+*				kernel is written once with the grid as a constant
+*				argument and inlined into a copy per grid, so neither
+*				copy tests it while stepping.
+**************************************************************/
+#ifndef RAY_KERNEL_H
+#define RAY_KERNEL_H
+
+#define RAY_DOUBLE			0
+#define RAY_FLOAT			1
+#define RAY_FIXED			2
+#ifndef RAY_PRECISION
+#define RAY_PRECISION		RAY_DOUBLE
+#endif
+
+#if (defined(__x86_64__) || defined(__i386__)) && RAY_PRECISION == RAY_DOUBLE
+#define RAY_KERNEL_X86		1
+#include <emmintrin.h>		// SSE2
+#include <immintrin.h>		// AVX2 (only used in functions built with target("avx2"))
+#endif
+
+#define KERNEL_SCALAR		0
+#define KERNEL_SSE2			1
+#define KERNEL_AVX2			2
+#define KERNEL_SKIP			3
+#define KERNEL_AUTO			-1
+
+#define GRID_CELLS			0
+#define GRID_MORTON			1
+#define GRID_AUTO			-1
+
+#define SKIP_OFF			0
+#define SKIP_ON				1
+#define SKIP_AUTO			-1
+
+/* Result of one ray: the wall cell it stopped in and how far away it is */
+typedef struct {
+	double perpWallDist;	// distance projected on the camera direction
+	int mapX;
+	int mapY;
+	int side;				// 0 = an x-side was hit, 1 = a y-side
+	int steps;				// cells looked at on the way (for benchmarks)
+	int texX;				// texture column, filled in after casting when walls are textured
+} ColumnHit;
+
+int rayKernel = KERNEL_AUTO;
+int emptySkip = SKIP_AUTO;	// see -skip
+int rayGrid = GRID_AUTO;	// see -grid; anything but GRID_MORTON reads the cells
+const char *rayKernelNames[] = {"scalar", "sse2", "avx2", "skip"};
+const char *rayPrecisionNames[] = {"double", "float", "16.16 fixed point"};
+const char *rayGridNames[] = {"cells", "morton"};
+
+/* Length of ray from its origin to the grid line after the given number of steps along one axis */
+static inline double SideDistAfter(double sideDist0, double deltaDist, int steps){
+	return steps == 0 ? sideDist0 : sideDist0 + steps * deltaDist;
+}
+
+/* Distance projected on camera direction, shared by every kernel */
+static inline double PerpWallDist(double posX, double posY, double rayDirX, double rayDirY, int mapX, int mapY, int side){
+	if (side == 0){
+		int stepX = rayDirX < 0 ? -1 : 1;
+		return (mapX - posX + (1 - stepX) / 2) / rayDirX;
+	}
+	int stepY = rayDirY < 0 ? -1 : 1;
+	return (mapY - posY + (1 - stepY) / 2) / rayDirY;
+}
+
+/* ---- TraceRayOn() ---------------------------------------
+* Parameters: 	ray origin, ray direction, limit - farthest point
+*				to look at, in multiples of the direction, result,
+*				grid - GRID_CELLS or GRID_MORTON, a constant
+* Type: 		Public
+* Return:		TRUE if a wall was hit before the limit
+* Description:
+*	Scalar reference DDA. Walks the map one grid line at a time
+*	until it enters a non-empty cell, or would enter one that
+*	starts past the limit (result untouched). Rendering passes
+*	an infinite limit (CastRayDouble()); gameplay queries pass
+*	their range (RayQuery.h).
+* --------------------------------- end TraceRayOn() ---- */
+static inline __attribute__((always_inline)) bool TraceRayOn(double posX, double posY, double rayDirX, double rayDirY, double limit, ColumnHit *hit, const int grid){
+	// Which box of the map we're in
+	int mapX = (int) posX;
+	int mapY = (int) posY;
+	// Length of ray from one side to the next
+	double deltaDistX = fabs(1 / rayDirX);
+	double deltaDistY = fabs(1 / rayDirY);
+	// Length of ray from its origin to the first x or y-side
+	double sideDistX0;
+	double sideDistY0;
+	// What direction to step in x or y-direction (either +1 or -1)
+	int stepX;
+	int stepY;
+	int side = 0;
+	// Calculate step and initial sideDist
+	if (rayDirX < 0){
+		stepX = -1;
+		sideDistX0 = (posX - mapX) * deltaDistX;
+	}
+	else{
+		stepX = 1;
+		sideDistX0 = (mapX + 1.0 - posX) * deltaDistX;
+	}
+	if (rayDirY < 0){
+		stepY = -1;
+		sideDistY0 = (posY - mapY) * deltaDistY;
+	}
+	else{
+		stepY = 1;
+		sideDistY0 = (mapY + 1.0 - posY) * deltaDistY;
+	}
+	// Length of ray from current position to next x or y-side
+	double sideDistX = sideDistX0;
+	double sideDistY = sideDistY0;
+	int stepsX = 0;
+	int stepsY = 0;
+	// The same box as Morton bits, for the occupancy grid
+	uint64_t mortonX = grid == GRID_MORTON ? DilateBits((uint32_t)mapX) << 1 : 0;
+	uint64_t mortonY = grid == GRID_MORTON ? DilateBits((uint32_t)mapY) : 0;
+	const uint64_t moveX = MortonMove(stepX, MORTON_X);
+	const uint64_t moveY = MortonMove(stepY, MORTON_Y);
+	/* Simple Digital Differential Analysis Algorithm */
+	// determines distance to next grid line, so that we can check if a wall's there
+	do{
+		// Stop short of a square that starts out of range
+		if ((sideDistX < sideDistY ? sideDistX : sideDistY) > limit) return FALSE;
+		// Jump to next map square, OR in x-direction, OR in y-direction
+		if (sideDistX < sideDistY){
+			stepsX++;
+			sideDistX = SideDistAfter(sideDistX0, deltaDistX, stepsX);
+			mapX += stepX;
+			if (grid == GRID_MORTON) mortonX = MortonStep(mortonX, moveX, MORTON_X);
+			side = 0;
+		}
+		else{
+			stepsY++;
+			sideDistY = SideDistAfter(sideDistY0, deltaDistY, stepsY);
+			mapY += stepY;
+			if (grid == GRID_MORTON) mortonY = MortonStep(mortonY, moveY, MORTON_Y);
+			side = 1;
+		}
+		// Check if ray has hit a wall (or out of bounds)
+	} while (grid == GRID_MORTON ? !SolidBit(mortonX | mortonY) : WORLD_CELL(mapX, mapY) == 0);
+
+	hit->mapX = mapX;
+	hit->mapY = mapY;
+	hit->side = side;
+	hit->steps = stepsX + stepsY;
+	hit->perpWallDist = PerpWallDist(posX, posY, rayDirX, rayDirY, mapX, mapY, side);
+	return TRUE;
+}
+
+/* TraceRayOn() in the grid -grid selected */
+static inline bool TraceRay(double posX, double posY, double rayDirX, double rayDirY, double limit, ColumnHit *hit){
+	if (rayGrid == GRID_MORTON) return TraceRayOn(posX, posY, rayDirX, rayDirY, limit, hit, GRID_MORTON);
+	return TraceRayOn(posX, posY, rayDirX, rayDirY, limit, hit, GRID_CELLS);
+}
+
+/* The renderer's ray: TraceRay() without a limit (maps are enclosed, so it always hits) */
+void CastRayDouble(double posX, double posY, double rayDirX, double rayDirY, ColumnHit *hit){
+	TraceRay(posX, posY, rayDirX, rayDirY, INFINITY, hit);
+}
+
+#if RAY_PRECISION == RAY_FLOAT
+/* CastRayDouble() in single precision */
+void CastRayFloat(double posX, double posY, double rayDirX, double rayDirY, ColumnHit *hit){
+	float originX = (float) posX;
+	float originY = (float) posY;
+	float dirX = (float) rayDirX;
+	float dirY = (float) rayDirY;
+	int mapX = (int) originX;
+	int mapY = (int) originY;
+	float deltaDistX = fabsf(1.0f / dirX);
+	float deltaDistY = fabsf(1.0f / dirY);
+	int stepX = dirX < 0 ? -1 : 1;
+	int stepY = dirY < 0 ? -1 : 1;
+	float sideDistX0 = (dirX < 0 ? originX - mapX : mapX + 1.0f - originX) * deltaDistX;
+	float sideDistY0 = (dirY < 0 ? originY - mapY : mapY + 1.0f - originY) * deltaDistY;
+	float sideDistX = sideDistX0;
+	float sideDistY = sideDistY0;
+	int stepsX = 0;
+	int stepsY = 0;
+	int side = 0;
+	do{
+		if (sideDistX < sideDistY){
+			stepsX++;
+			sideDistX = sideDistX0 + stepsX * deltaDistX;
+			mapX += stepX;
+			side = 0;
+		}
+		else{
+			stepsY++;
+			sideDistY = sideDistY0 + stepsY * deltaDistY;
+			mapY += stepY;
+			side = 1;
+		}
+	} while (WORLD_CELL(mapX, mapY) == 0);
+
+	hit->mapX = mapX;
+	hit->mapY = mapY;
+	hit->side = side;
+	hit->steps = stepsX + stepsY;
+	// The last step added one deltaDist past the wall's grid line
+	hit->perpWallDist = side == 0 ? sideDistX - deltaDistX : sideDistY - deltaDistY;
+}
+#define CastRay				CastRayFloat
+#elif RAY_PRECISION == RAY_FIXED
+// sideDist/deltaDist are 16.16 fixed point. Ray directions (|dir| < 2, longer ones are halved first) and the
+// position within the start cell are converted with 30 fraction bits: a 16-bit
+// fraction is too coarse for rays that only just clear a corner.
+#define FIXED_SHIFT			16
+#define FIXED_ONE			(1 << FIXED_SHIFT)
+#define INPUT_SHIFT			30
+#define INPUT_ONE			(1 << INPUT_SHIFT)
+#define FIXED_DELTA_MAX		(1 << 29)	// deltaDist of (nearly) axis-parallel rays; sideDist stays below 2^31 on 4096-cell maps
+#define RECIPROCAL_BITS		8			// table entries per octave
+
+// 2^31 / m for m = 1 + i / 2^RECIPROCAL_BITS, i = 0..2^RECIPROCAL_BITS
+uint32_t reciprocalTable[(1 << RECIPROCAL_BITS) + 1];
+
+void BuildReciprocalTable(){
+	for (int i = 0; i <= (1 << RECIPROCAL_BITS); i++){
+		reciprocalTable[i] = (uint32_t)(2147483648.0 / (1.0 + (double)i / (1 << RECIPROCAL_BITS)) + 0.5);
+	}
+}
+
+/* ---- FixedReciprocal() ---------------------------------------
+* Parameters: 	x - positive 2.30 value
+* Type: 		Public
+* Return:		1 / x in 16.16, at most FIXED_DELTA_MAX
+* Description:
+*	Table lookup instead of a divide: x is normalised to a
+*	mantissa m in [1, 2) times 2^top, the top mantissa bits pick a
+*	table entry and the next 15 interpolate to the one after it
+*	(relative error about 1e-5).
+* --------------------------------- end FixedReciprocal() ---- */
+static inline int32_t FixedReciprocal(uint32_t x){
+	if (x < (1u << 17)) return FIXED_DELTA_MAX;
+	int top = 31 - __builtin_clz(x);
+	uint32_t mantissa = x << (31 - top);	// 1.31, top bit set
+	uint32_t index = (mantissa >> (31 - RECIPROCAL_BITS)) & ((1 << RECIPROCAL_BITS) - 1);
+	uint32_t weight = (mantissa >> (31 - RECIPROCAL_BITS - 15)) & 0x7FFF;
+	uint32_t reciprocal = reciprocalTable[index] - (uint32_t)(((uint64_t)(reciprocalTable[index] - reciprocalTable[index + 1]) * weight) >> 15);
+	// x is m * 2^top, so 1/x in 16.16 is 2^46 / x = (2^31 / m) >> (top - 15); top >= 17 keeps it under 2^30
+	uint32_t result = reciprocal >> (top - 15);
+	return result > FIXED_DELTA_MAX ? FIXED_DELTA_MAX : (int32_t)result;
+}
+
+/* ---- CastRayFixed() ---------------------------------------
+* Parameters: 	ray origin, ray direction, result
+* Type: 		Public
+* Return:		None
+* Description:
+*	CastRayDouble() in 16.16 fixed point. deltaDist comes from the
+*	reciprocal table, so the loop is integer adds and compares only,
+*	and perpWallDist is the last sideDist minus one deltaDist.
+*	Can pick the neighbouring cell where a ray passes within about
+*	1/65536 of a corner; column heights stay within a pixel of the
+*	double kernel (make check-precision).
+*	Directions with a component of 2 or more are halved until both
+*	fit the input format; only the direction matters to the walk,
+*	and perpWallDist is scaled back to the caller's ray.
+* --------------------------------- end CastRayFixed() ---- */
+void CastRayFixed(double posX, double posY, double rayDirX, double rayDirY, ColumnHit *hit){
+	int mapX = (int) posX;
+	int mapY = (int) posY;
+	int exponent;
+	frexp(fabs(rayDirX) > fabs(rayDirY) ? rayDirX : rayDirY, &exponent); // longest component is below 2 to the exponent
+	int scale = exponent > 1 ? exponent - 1 : 0;
+	rayDirX = ldexp(rayDirX, -scale);
+	rayDirY = ldexp(rayDirY, -scale);
+	int32_t fractionX = (int32_t)((posX - mapX) * INPUT_ONE);
+	int32_t fractionY = (int32_t)((posY - mapY) * INPUT_ONE);
+	int32_t dirX = (int32_t)(rayDirX * INPUT_ONE);
+	int32_t dirY = (int32_t)(rayDirY * INPUT_ONE);
+	int32_t deltaDistX = FixedReciprocal(dirX < 0 ? -dirX : dirX);
+	int32_t deltaDistY = FixedReciprocal(dirY < 0 ? -dirY : dirY);
+	int stepX = dirX < 0 ? -1 : 1;
+	int stepY = dirY < 0 ? -1 : 1;
+	int32_t sideDistX = (int32_t)(((int64_t)(dirX < 0 ? fractionX : INPUT_ONE - fractionX) * deltaDistX) >> INPUT_SHIFT);
+	int32_t sideDistY = (int32_t)(((int64_t)(dirY < 0 ? fractionY : INPUT_ONE - fractionY) * deltaDistY) >> INPUT_SHIFT);
+	int steps = 0;
+	int side = 0;
+	do{
+		if (sideDistX < sideDistY){
+			sideDistX += deltaDistX;
+			mapX += stepX;
+			side = 0;
+		}
+		else{
+			sideDistY += deltaDistY;
+			mapY += stepY;
+			side = 1;
+		}
+		steps++;
+	} while (WORLD_CELL(mapX, mapY) == 0);
+
+	hit->mapX = mapX;
+	hit->mapY = mapY;
+	hit->side = side;
+	hit->steps = steps;
+	hit->perpWallDist = ldexp((double)(side == 0 ? sideDistX - deltaDistX : sideDistY - deltaDistY) / FIXED_ONE, -scale);
+}
+#define CastRay				CastRayFixed
+#else
+#define CastRay				CastRayDouble
+#endif
+
+/* Set up whatever the selected precision needs (the fixed point reciprocal table) */
+void InitRayPrecision(){
+#if RAY_PRECISION == RAY_FIXED
+	BuildReciprocalTable();
+#endif
+}
+
+/* Steps in [first, last] along one axis whose sideDist is below limit (or equal to it, if inclusive) */
+static inline int StepsBefore(double sideDist0, double deltaDist, double rayDir, double limit, int inclusive, int first, int last){
+	// Estimate (|rayDir| is 1 / deltaDist), then settle the rounding against SideDistAfter() itself
+	double estimate = (limit - sideDist0) * fabs(rayDir) + 1;
+	int steps = estimate >= last ? last : (estimate > first ? (int)estimate : first);
+	while (steps < last && (inclusive ? SideDistAfter(sideDist0, deltaDist, steps) <= limit : SideDistAfter(sideDist0, deltaDist, steps) < limit)) steps++;
+	while (steps > first && !(inclusive ? SideDistAfter(sideDist0, deltaDist, steps - 1) <= limit : SideDistAfter(sideDist0, deltaDist, steps - 1) < limit)) steps--;
+	return steps;
+}
+
+/* ---- CastRaySkip() ---------------------------------------
+* Parameters: 	ray origin, ray direction, result
+* Type: 		Public
+* Return:		None
+* Description:
+*	CastRay() that looks at world.distance instead of the cells.
+*	A cell whose distance is d has no wall within d-1 cells of it
+*	in any direction, so the DDA cannot hit anything until it
+*	leaves that square. Instead of stepping there, jump straight
+*	to the last state before it leaves: work out which side it
+*	leaves through, then how many steps the other axis takes
+*	first. The steps are counted the same way as CastRay(), so it
+*	ends on exactly the same hit. Needs BuildDistanceField().
+* --------------------------------- end CastRaySkip() ---- */
+void CastRaySkip(double posX, double posY, double rayDirX, double rayDirY, ColumnHit *hit){
+	const uint8_t *distance = world.distance;
+	const int startX = (int) posX;
+	const int startY = (int) posY;
+	double deltaDistX = fabs(1 / rayDirX);
+	double deltaDistY = fabs(1 / rayDirY);
+	int stepX = rayDirX < 0 ? -1 : 1;
+	int stepY = rayDirY < 0 ? -1 : 1;
+	double sideDistX0 = (rayDirX < 0 ? posX - startX : startX + 1.0 - posX) * deltaDistX;
+	double sideDistY0 = (rayDirY < 0 ? posY - startY : startY + 1.0 - posY) * deltaDistY;
+	double sideDistX = sideDistX0;
+	double sideDistY = sideDistY0;
+	int mapX = startX;
+	int mapY = startY;
+	int stepsX = 0;
+	int stepsY = 0;
+	int side = 0;
+	int lookups = 0;
+	int clearance;
+
+	for (;;){
+		if (sideDistX < sideDistY){
+			stepsX++;
+			sideDistX = SideDistAfter(sideDistX0, deltaDistX, stepsX);
+			mapX += stepX;
+			side = 0;
+		}
+		else{
+			stepsY++;
+			sideDistY = SideDistAfter(sideDistY0, deltaDistY, stepsY);
+			mapY += stepY;
+			side = 1;
+		}
+		lookups++;
+		clearance = distance[(size_t)mapX * WORLD_ROW + mapY];
+		if (clearance == 0) break;
+		if (clearance > 1){
+			// The ray leaves the empty square on the step after the last one it may take along either axis
+			int lastX = stepsX + clearance - 1;
+			int lastY = stepsY + clearance - 1;
+			double exitX = SideDistAfter(sideDistX0, deltaDistX, lastX);
+			double exitY = SideDistAfter(sideDistY0, deltaDistY, lastY);
+			if (exitX < exitY){
+				stepsY = StepsBefore(sideDistY0, deltaDistY, rayDirY, exitX, TRUE, stepsY, lastY);
+				stepsX = lastX;
+			}
+			else{
+				stepsX = StepsBefore(sideDistX0, deltaDistX, rayDirX, exitY, FALSE, stepsX, lastX);
+				stepsY = lastY;
+			}
+			sideDistX = SideDistAfter(sideDistX0, deltaDistX, stepsX);
+			sideDistY = SideDistAfter(sideDistY0, deltaDistY, stepsY);
+			mapX = startX + stepsX * stepX;
+			mapY = startY + stepsY * stepY;
+		}
+	}
+
+	hit->mapX = mapX;
+	hit->mapY = mapY;
+	hit->side = side;
+	hit->steps = lookups;
+	hit->perpWallDist = PerpWallDist(posX, posY, rayDirX, rayDirY, mapX, mapY, side);
+}
+
+#ifdef RAY_KERNEL_X86
+// Rays per call of each packet kernel. Each register holds 2 (SSE2) or
+// 4 (AVX2) double lanes; several independent register groups are stepped
+// in the same loop so one group's map lookups overlap the others' math.
+#define SSE2_PACKET			4
+#define AVX2_PACKET			16
+#define SSE2_GROUPS			(SSE2_PACKET / 2)
+#define AVX2_GROUPS			(AVX2_PACKET / 4)
+
+/* Select a where mask is set, b elsewhere (SSE2 has no blendv) */
+static inline __m128d Select128d(__m128d mask, __m128d a, __m128d b){
+	return _mm_or_pd(_mm_and_pd(mask, a), _mm_andnot_pd(mask, b));
+}
+
+/* Write a finished packet back out as ColumnHits (cell or Morton index -> mapX/mapY) */
+static inline void StorePacket(double posX, double posY, const double *rayDirX, const double *rayDirY, const long long *cellIndex, const long long *side, const double *steps, int lanes, ColumnHit *hits, const int grid){
+	for (int lane = 0; lane < lanes; lane++){
+		hits[lane].mapX = grid == GRID_MORTON ? (int)CompactBits((uint64_t)cellIndex[lane] >> 1) : (int)(cellIndex[lane] / WORLD_ROW);
+		hits[lane].mapY = grid == GRID_MORTON ? (int)CompactBits((uint64_t)cellIndex[lane]) : (int)(cellIndex[lane] % WORLD_ROW);
+		hits[lane].side = (int)side[lane];
+		hits[lane].steps = (int)steps[lane];
+		hits[lane].perpWallDist = PerpWallDist(posX, posY, rayDirX[lane], rayDirY[lane], hits[lane].mapX, hits[lane].mapY, hits[lane].side);
+	}
+}
+
+/* Keep a where mask is set, b elsewhere */
+static inline __m128i Select128i(__m128d mask, __m128i a, __m128i b){
+	return _mm_or_si128(_mm_and_si128(_mm_castpd_si128(mask), a), _mm_andnot_si128(_mm_castpd_si128(mask), b));
+}
+
+/* ---- CastRays4SSE2On() ---------------------------------------
+* Parameters: 	ray origin, 4 ray directions, 4 results, grid -
+*				GRID_CELLS or GRID_MORTON, a constant
+* Type: 		Public
+* Return:		None
+* Description:
+*	Steps 4 rays at once as two groups of 2 double lanes. Masks
+*	and cell indices are kept 64 bits wide to line up with the
+*	doubles; SSE2 has no gather so the map lookups are
+*	scalar loads.
+* --------------------------------- end CastRays4SSE2On() ---- */
+static inline __attribute__((always_inline)) void CastRays4SSE2On(double posX, double posY, const double *rayDirX, const double *rayDirY, ColumnHit *hits, const int grid){
+	const uint8_t *cells = world.cells;
+	const long long rowLength = WORLD_ROW;
+	// Every ray in the packet starts in the same box
+	int mapX = (int) posX;
+	int mapY = (int) posY;
+	const __m128d nearX = _mm_set1_pd(posX - mapX);
+	const __m128d farX = _mm_set1_pd(mapX + 1.0 - posX);
+	const __m128d nearY = _mm_set1_pd(posY - mapY);
+	const __m128d farY = _mm_set1_pd(mapY + 1.0 - posY);
+	const __m128d signBit = _mm_set1_pd(-0.0);
+	const __m128d zero = _mm_setzero_pd();
+	const __m128d one = _mm_set1_pd(1.0);
+	const __m128i oneLane = _mm_set1_epi64x(1);
+	const __m128i mortonMaskX = _mm_set1_epi64x((long long)MORTON_X);
+	const __m128i mortonMaskY = _mm_set1_epi64x((long long)MORTON_Y);
+
+	// Calculate deltaDist, initial sideDist and the cell index step of every lane
+	__m128d sideX0[SSE2_GROUPS], sideY0[SSE2_GROUPS], sideX[SSE2_GROUPS], sideY[SSE2_GROUPS], deltaX[SSE2_GROUPS], deltaY[SSE2_GROUPS];
+	__m128d stepsX[SSE2_GROUPS], stepsY[SSE2_GROUPS], active[SSE2_GROUPS];
+	__m128i stepX[SSE2_GROUPS], stepY[SSE2_GROUPS], cellIndex[SSE2_GROUPS], side[SSE2_GROUPS];
+	__m128i mortonX[SSE2_GROUPS], mortonY[SSE2_GROUPS], moveX[SSE2_GROUPS], moveY[SSE2_GROUPS];
+	for (int group = 0; group < SSE2_GROUPS; group++){
+		__m128d dirX = _mm_loadu_pd(rayDirX + group * 2);
+		__m128d dirY = _mm_loadu_pd(rayDirY + group * 2);
+		__m128d negX = _mm_cmplt_pd(dirX, zero);
+		__m128d negY = _mm_cmplt_pd(dirY, zero);
+		deltaX[group] = _mm_andnot_pd(signBit, _mm_div_pd(one, dirX));
+		deltaY[group] = _mm_andnot_pd(signBit, _mm_div_pd(one, dirY));
+		sideX0[group] = sideX[group] = _mm_mul_pd(Select128d(negX, nearX, farX), deltaX[group]);
+		sideY0[group] = sideY[group] = _mm_mul_pd(Select128d(negY, nearY, farY), deltaY[group]);
+		stepsX[group] = stepsY[group] = zero;
+		stepX[group] = _mm_castpd_si128(Select128d(negX, _mm_castsi128_pd(_mm_set1_epi64x(-rowLength)), _mm_castsi128_pd(_mm_set1_epi64x(rowLength))));
+		stepY[group] = _mm_castpd_si128(Select128d(negY, _mm_castsi128_pd(_mm_set1_epi64x(-1)), _mm_castsi128_pd(oneLane)));
+		cellIndex[group] = _mm_set1_epi64x(mapX * rowLength + mapY);
+		side[group] = _mm_setzero_si128();
+		active[group] = _mm_cmpeq_pd(zero, zero);
+		mortonX[group] = _mm_set1_epi64x((long long)(DilateBits((uint32_t)mapX) << 1));
+		mortonY[group] = _mm_set1_epi64x((long long)DilateBits((uint32_t)mapY));
+		moveX[group] = Select128i(negX, _mm_set1_epi64x((long long)MortonMove(-1, MORTON_X)), mortonMaskX);
+		moveY[group] = Select128i(negY, _mm_set1_epi64x((long long)MortonMove(-1, MORTON_Y)), mortonMaskY);
+	}
+
+	int anyActive;
+	do{
+		anyActive = 0;
+#pragma GCC unroll 2
+		for (int group = 0; group < SSE2_GROUPS; group++){
+			// X step where sideDistX < sideDistY, Y step elsewhere; only active lanes move
+			__m128d lessX = _mm_cmplt_pd(sideX[group], sideY[group]);
+			__m128d takeX = _mm_and_pd(lessX, active[group]);
+			__m128d takeY = _mm_andnot_pd(lessX, active[group]);
+			stepsX[group] = _mm_add_pd(stepsX[group], _mm_and_pd(takeX, one));
+			stepsY[group] = _mm_add_pd(stepsY[group], _mm_and_pd(takeY, one));
+			sideX[group] = Select128d(takeX, _mm_add_pd(sideX0[group], _mm_mul_pd(stepsX[group], deltaX[group])), sideX[group]);
+			sideY[group] = Select128d(takeY, _mm_add_pd(sideY0[group], _mm_mul_pd(stepsY[group], deltaY[group])), sideY[group]);
+			if (grid == GRID_CELLS){
+				__m128i step = _mm_or_si128(_mm_and_si128(_mm_castpd_si128(takeX), stepX[group]), _mm_and_si128(_mm_castpd_si128(takeY), stepY[group]));
+				cellIndex[group] = _mm_add_epi64(cellIndex[group], step);
+			}
+			side[group] = _mm_castpd_si128(Select128d(active[group], _mm_castsi128_pd(_mm_and_si128(_mm_castpd_si128(takeY), oneLane)), _mm_castsi128_pd(side[group])));
+
+			// Check which rays have hit a wall
+			long long index[2];
+			__m128i empty;
+			if (grid == GRID_MORTON){
+				mortonX[group] = Select128i(takeX, _mm_and_si128(_mm_sub_epi64(mortonX[group], moveX[group]), mortonMaskX), mortonX[group]);
+				mortonY[group] = Select128i(takeY, _mm_and_si128(_mm_sub_epi64(mortonY[group], moveY[group]), mortonMaskY), mortonY[group]);
+				_mm_storeu_si128((__m128i *)index, _mm_or_si128(mortonX[group], mortonY[group]));
+				empty = _mm_set_epi64x(SolidBit(index[1]) ? 0 : -1, SolidBit(index[0]) ? 0 : -1);
+			}
+			else{
+				_mm_storeu_si128((__m128i *)index, cellIndex[group]);
+				empty = _mm_set_epi64x(cells[index[1]] == 0 ? -1 : 0, cells[index[0]] == 0 ? -1 : 0);
+			}
+			active[group] = _mm_and_pd(active[group], _mm_castsi128_pd(empty));
+			anyActive |= _mm_movemask_pd(active[group]);
+		}
+	} while (anyActive);
+
+	long long hitIndex[SSE2_PACKET], hitSide[SSE2_PACKET];
+	double hitSteps[SSE2_PACKET];
+	for (int group = 0; group < SSE2_GROUPS; group++){
+		_mm_storeu_si128((__m128i *)(hitIndex + group * 2), grid == GRID_MORTON ? _mm_or_si128(mortonX[group], mortonY[group]) : cellIndex[group]);
+		_mm_storeu_si128((__m128i *)(hitSide + group * 2), side[group]);
+		_mm_storeu_pd(hitSteps + group * 2, _mm_add_pd(stepsX[group], stepsY[group]));
+	}
+	StorePacket(posX, posY, rayDirX, rayDirY, hitIndex, hitSide, hitSteps, SSE2_PACKET, hits, grid);
+}
+
+/* CastRays4SSE2On() in the grid -grid selected */
+void CastRays4SSE2(double posX, double posY, const double *rayDirX, const double *rayDirY, ColumnHit *hits){
+	if (rayGrid == GRID_MORTON) CastRays4SSE2On(posX, posY, rayDirX, rayDirY, hits, GRID_MORTON);
+	else CastRays4SSE2On(posX, posY, rayDirX, rayDirY, hits, GRID_CELLS);
+}
+
+/* ---- CastRays16AVX2On() ---------------------------------------
+* Parameters: 	ray origin, 16 ray directions, 16 results, grid -
+*				GRID_CELLS or GRID_MORTON, a constant
+* Type: 		Public
+* Return:		None
+* Description:
+*	Steps 16 rays at once as four groups of 4 double lanes, each
+*	with one masked gather per step for its map lookups. Cells are
+*	bytes, so the gather reads a 32-bit word at each cell and keeps
+*	the low byte (map files are padded so the last cell is safe).
+*	In the occupancy grid it reads the 32-bit word holding each
+*	cell's bit and shifts the bit down instead.
+*	Built for AVX2 only (no FMA) so the compiler cannot contract
+*	the arithmetic differently from the scalar kernel.
+* --------------------------------- end CastRays16AVX2On() ---- */
+__attribute__((target("avx2"), always_inline))
+static inline void CastRays16AVX2On(double posX, double posY, const double *rayDirX, const double *rayDirY, ColumnHit *hits, const int grid){
+	// Every ray in the packet starts in the same box
+	int mapX = (int) posX;
+	int mapY = (int) posY;
+	const __m256d nearX = _mm256_set1_pd(posX - mapX);
+	const __m256d farX = _mm256_set1_pd(mapX + 1.0 - posX);
+	const __m256d nearY = _mm256_set1_pd(posY - mapY);
+	const __m256d farY = _mm256_set1_pd(mapY + 1.0 - posY);
+	const __m256d signBit = _mm256_set1_pd(-0.0);
+	const __m256d zero = _mm256_setzero_pd();
+	const __m256d one = _mm256_set1_pd(1.0);
+	const __m256i oneLane = _mm256_set1_epi64x(1);
+	const __m128i cellMask = _mm_set1_epi32(0xFF);
+	const __m128i bitMask = _mm_set1_epi32(31);
+	const __m128i lowBit = _mm_set1_epi32(1);
+	const __m256i mortonMaskX = _mm256_set1_epi64x((long long)MORTON_X);
+	const __m256i mortonMaskY = _mm256_set1_epi64x((long long)MORTON_Y);
+	const long long rowLength = WORLD_ROW;
+
+	// Calculate deltaDist, initial sideDist and the cell index step of every lane
+	__m256d sideX0[AVX2_GROUPS], sideY0[AVX2_GROUPS], sideX[AVX2_GROUPS], sideY[AVX2_GROUPS], deltaX[AVX2_GROUPS], deltaY[AVX2_GROUPS];
+	__m256d stepsX[AVX2_GROUPS], stepsY[AVX2_GROUPS];
+	__m256i stepX[AVX2_GROUPS], stepY[AVX2_GROUPS], cellIndex[AVX2_GROUPS], side[AVX2_GROUPS], active[AVX2_GROUPS];
+	__m256i mortonX[AVX2_GROUPS], mortonY[AVX2_GROUPS], moveX[AVX2_GROUPS], moveY[AVX2_GROUPS];
+	for (int group = 0; group < AVX2_GROUPS; group++){
+		__m256d dirX = _mm256_loadu_pd(rayDirX + group * 4);
+		__m256d dirY = _mm256_loadu_pd(rayDirY + group * 4);
+		__m256d negX = _mm256_cmp_pd(dirX, zero, _CMP_LT_OQ);
+		__m256d negY = _mm256_cmp_pd(dirY, zero, _CMP_LT_OQ);
+		deltaX[group] = _mm256_andnot_pd(signBit, _mm256_div_pd(one, dirX));
+		deltaY[group] = _mm256_andnot_pd(signBit, _mm256_div_pd(one, dirY));
+		sideX0[group] = sideX[group] = _mm256_mul_pd(_mm256_blendv_pd(farX, nearX, negX), deltaX[group]);
+		sideY0[group] = sideY[group] = _mm256_mul_pd(_mm256_blendv_pd(farY, nearY, negY), deltaY[group]);
+		stepsX[group] = stepsY[group] = zero;
+		stepX[group] = _mm256_blendv_epi8(_mm256_set1_epi64x(rowLength), _mm256_set1_epi64x(-rowLength), _mm256_castpd_si256(negX));
+		stepY[group] = _mm256_blendv_epi8(oneLane, _mm256_set1_epi64x(-1), _mm256_castpd_si256(negY));
+		cellIndex[group] = _mm256_set1_epi64x(mapX * rowLength + mapY);
+		side[group] = _mm256_setzero_si256();
+		active[group] = _mm256_set1_epi64x(-1);
+		mortonX[group] = _mm256_set1_epi64x((long long)(DilateBits((uint32_t)mapX) << 1));
+		mortonY[group] = _mm256_set1_epi64x((long long)DilateBits((uint32_t)mapY));
+		moveX[group] = _mm256_blendv_epi8(mortonMaskX, _mm256_set1_epi64x((long long)MortonMove(-1, MORTON_X)), _mm256_castpd_si256(negX));
+		moveY[group] = _mm256_blendv_epi8(mortonMaskY, _mm256_set1_epi64x((long long)MortonMove(-1, MORTON_Y)), _mm256_castpd_si256(negY));
+	}
+
+	int anyActive;
+	int groupActive[AVX2_GROUPS];	// lane bits still stepping; finished groups are skipped
+	for (int group = 0; group < AVX2_GROUPS; group++) groupActive[group] = 0xF;
+	do{
+		anyActive = 0;
+#pragma GCC unroll 4
+		for (int group = 0; group < AVX2_GROUPS; group++){
+			if (!groupActive[group]) continue;
+			// X step where sideDistX < sideDistY, Y step elsewhere; only active lanes move
+			__m256i lessX = _mm256_castpd_si256(_mm256_cmp_pd(sideX[group], sideY[group], _CMP_LT_OQ));
+			__m256i takeX = _mm256_and_si256(lessX, active[group]);
+			__m256i takeY = _mm256_andnot_si256(lessX, active[group]);
+			stepsX[group] = _mm256_add_pd(stepsX[group], _mm256_and_pd(_mm256_castsi256_pd(takeX), one));
+			stepsY[group] = _mm256_add_pd(stepsY[group], _mm256_and_pd(_mm256_castsi256_pd(takeY), one));
+			sideX[group] = _mm256_blendv_pd(sideX[group], _mm256_add_pd(sideX0[group], _mm256_mul_pd(stepsX[group], deltaX[group])), _mm256_castsi256_pd(takeX));
+			sideY[group] = _mm256_blendv_pd(sideY[group], _mm256_add_pd(sideY0[group], _mm256_mul_pd(stepsY[group], deltaY[group])), _mm256_castsi256_pd(takeY));
+			if (grid == GRID_CELLS){
+				__m256i step = _mm256_and_si256(_mm256_blendv_epi8(stepY[group], stepX[group], lessX), active[group]);
+				cellIndex[group] = _mm256_add_epi64(cellIndex[group], step);
+			}
+			side[group] = _mm256_blendv_epi8(side[group], _mm256_and_si256(takeY, oneLane), active[group]);
+
+			// Gather the cells the active rays moved into and check which hit a wall
+			__m128i gatherMask = _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(active[group], _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6)));
+			__m128i cell;
+			if (grid == GRID_MORTON){
+				mortonX[group] = _mm256_blendv_epi8(mortonX[group], _mm256_and_si256(_mm256_sub_epi64(mortonX[group], moveX[group]), mortonMaskX), takeX);
+				mortonY[group] = _mm256_blendv_epi8(mortonY[group], _mm256_and_si256(_mm256_sub_epi64(mortonY[group], moveY[group]), mortonMaskY), takeY);
+				__m256i bit = _mm256_or_si256(mortonX[group], mortonY[group]);
+				__m128i shift = _mm_and_si128(_mm256_castsi256_si128(_mm256_permutevar8x32_epi32(bit, _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6))), bitMask);
+				__m128i word = _mm256_mask_i64gather_epi32(_mm_setzero_si128(), (const int *)world.solid, _mm256_srli_epi64(bit, 5), gatherMask, 4);
+				cell = _mm_and_si128(_mm_srlv_epi32(word, shift), lowBit);
+			}
+			else{
+				cell = _mm_and_si128(_mm256_mask_i64gather_epi32(_mm_setzero_si128(), (const int *)world.cells, cellIndex[group], gatherMask, 1), cellMask);
+			}
+			active[group] = _mm256_and_si256(active[group], _mm256_cmpgt_epi64(oneLane, _mm256_cvtepi32_epi64(cell)));
+			groupActive[group] = _mm256_movemask_pd(_mm256_castsi256_pd(active[group]));
+			anyActive |= groupActive[group];
+		}
+	} while (anyActive);
+
+	long long hitIndex[AVX2_PACKET], hitSide[AVX2_PACKET];
+	double hitSteps[AVX2_PACKET];
+	for (int group = 0; group < AVX2_GROUPS; group++){
+		_mm256_storeu_si256((__m256i *)(hitIndex + group * 4), grid == GRID_MORTON ? _mm256_or_si256(mortonX[group], mortonY[group]) : cellIndex[group]);
+		_mm256_storeu_si256((__m256i *)(hitSide + group * 4), side[group]);
+		_mm256_storeu_pd(hitSteps + group * 4, _mm256_add_pd(stepsX[group], stepsY[group]));
+	}
+	StorePacket(posX, posY, rayDirX, rayDirY, hitIndex, hitSide, hitSteps, AVX2_PACKET, hits, grid);
+}
+
+/* CastRays16AVX2On() in the grid -grid selected */
+__attribute__((target("avx2")))
+void CastRays16AVX2(double posX, double posY, const double *rayDirX, const double *rayDirY, ColumnHit *hits){
+	if (rayGrid == GRID_MORTON) CastRays16AVX2On(posX, posY, rayDirX, rayDirY, hits, GRID_MORTON);
+	else CastRays16AVX2On(posX, posY, rayDirX, rayDirY, hits, GRID_CELLS);
+}
+#endif
+
+/* Widest kernel this CPU can run, or the requested one if it is supported */
+int SelectRayKernel(int requested){
+	int best = KERNEL_SCALAR;
+	// Skipping reproduces CastRayDouble() exactly, so it is only offered in double builds
+	if (requested == KERNEL_SKIP) return world.distance != NULL && RAY_PRECISION == RAY_DOUBLE ? KERNEL_SKIP : KERNEL_SCALAR;
+#ifdef RAY_KERNEL_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse2")) best = KERNEL_SSE2;
+	if (__builtin_cpu_supports("avx2")) best = KERNEL_AVX2;
+#endif
+	if (requested == KERNEL_AUTO || requested > best) return best;
+	return requested;
+}
+
+/* Grid the kernels can test for walls in (GRID_AUTO stays to be timed); the float and fixed point kernels only read the cells */
+int SelectRayGrid(int requested){
+	if (RAY_PRECISION != RAY_DOUBLE || world.solid == NULL) return GRID_CELLS;
+	return requested;
+}
+
+/* ---- CastRays() ---------------------------------------
+* Parameters: 	ray origin, count ray directions, count results
+* Type: 		Public
+* Return:		None
+* Description:
+*	Casts a run of adjacent rays with the selected kernel,
+*	finishing any leftover rays with the scalar one.
+* --------------------------------- end CastRays() ---- */
+void CastRays(double posX, double posY, const double *rayDirX, const double *rayDirY, int count, ColumnHit *hits){
+	int i = 0;
+	if (rayKernel == KERNEL_SKIP){
+		for (; i < count; i++) CastRaySkip(posX, posY, rayDirX[i], rayDirY[i], &hits[i]);
+		return;
+	}
+#ifdef RAY_KERNEL_X86
+	if (rayKernel == KERNEL_AVX2){
+		for (; i + AVX2_PACKET <= count; i += AVX2_PACKET) CastRays16AVX2(posX, posY, rayDirX + i, rayDirY + i, hits + i);
+	}
+	if (rayKernel >= KERNEL_SSE2){
+		for (; i + SSE2_PACKET <= count; i += SSE2_PACKET) CastRays4SSE2(posX, posY, rayDirX + i, rayDirY + i, hits + i);
+	}
+#endif
+	for (; i < count; i++) CastRay(posX, posY, rayDirX[i], rayDirY[i], &hits[i]);
+}
+
+#endif
@@ -0,0 +1,194 @@
+/**************************************************************
+* FILENAME:		RayQuery.h
+*
+* DESCRIPTION:	Batched ray and line-of-sight queries against the
+*				world grid for gameplay and AI code.
+*
+* NOTES:		Queries walk the map with the renderer's own DDA
+*				(TraceRay() in RayKernel.h), bounded by a range, so
+*				a query reports exactly the cell, side and distance a
+*				screen column cast the same way would.
+*				A batch is first ordered by where its rays start (the
+*				Morton order of QUERY_BUCKET_CELLS-sized squares) and
+*				roughly which way they point, so neighbouring queries
+*				read the same map lines, then cut into tiles of
+*				QUERY_TILE queries spread over the worker pool. Each
+*				result goes back to its query's own position, so the
+*				order is invisible to callers. Called while another
+*				thread owns the pool (a pipelined frame), a batch runs
+*				on the calling thread instead.
+*				The cell a ray starts in is never tested, like the
+*				player's own cell when rendering; rays that start off
+*				the map are reported as blocked at distance 0.
+*				Queries read cells without atomics, like rays, so
+*				they must not overlap ApplyMapEdits() (MapEdit.h).
+**************************************************************/
+
+#define QUERY_TILE			64		// queries per ParallelFor() tile
+#define QUERY_BUCKET_BITS	4		// queries are ordered by 16x16-cell squares first
+#define QUERY_ANGLE_BINS	128		// then by direction
+
+/* Result of one query */
+typedef struct {
+	double distance;	// cells from the origin to the wall, or to the end of the range if nothing was hit
+	int mapX;			// the wall cell hit, -1 if none (or the ray started off the map)
+	int mapY;
+	int side;			// 0 = an x-side was hit, 1 = a y-side
+	bool hit;			// TRUE if a wall (or the map edge) stopped the ray
+} RayQueryHit;
+
+// A batch being run
+typedef struct {
+	const double *originX;
+	const double *originY;
+	const double *towardX;	// directions, or targets for line of sight
+	const double *towardY;
+	const double *range;	// NULL = unlimited
+	bool toTarget;
+	int count;
+	const uint64_t *order;	// sort key in the high half, query number in the low half
+	RayQueryHit *hits;
+} QueryBatch;
+
+/* Spread the low 16 bits of v to the even bits */
+static inline uint32_t SpreadBits(uint32_t v){
+	v &= 0xFFFF;
+	v = (v | (v << 8)) & 0x00FF00FF;
+	v = (v | (v << 4)) & 0x0F0F0F0F;
+	v = (v | (v << 2)) & 0x33333333;
+	v = (v | (v << 1)) & 0x55555555;
+	return v;
+}
+
+/* Cheap monotonic stand-in for the angle of (x, y): 0 to 4 around the circle */
+static inline double DiamondAngle(double x, double y){
+	double sum = fabs(x) + fabs(y);
+	if (sum == 0) return 0;
+	if (y >= 0) return x >= 0 ? y / sum : 1 - x / sum;
+	return x < 0 ? 2 - y / sum : 3 + x / sum;
+}
+
+/* Sort key of one query: the square its origin is in, then its direction */
+HIDDEN uint64_t QueryKey(double originX, double originY, double dirX, double dirY){
+	uint32_t square = SpreadBits((uint32_t)((int)originX >> QUERY_BUCKET_BITS)) << 1 | SpreadBits((uint32_t)((int)originY >> QUERY_BUCKET_BITS));
+	uint32_t angle = (uint32_t)(DiamondAngle(dirX, dirY) * (QUERY_ANGLE_BINS / 4)) & (QUERY_ANGLE_BINS - 1);
+	return (uint64_t)(square * QUERY_ANGLE_BINS + angle) << 32;
+}
+
+HIDDEN int CompareQueryKeys(const void *a, const void *b){
+	uint64_t keyA = *(const uint64_t *)a;
+	uint64_t keyB = *(const uint64_t *)b;
+	return (keyA > keyB) - (keyA < keyB);
+}
+
+/* ---- RunQuery() ---------------------------------------
+* Parameters: 	batch, number of the query in it
+* Type: 		Public
+* Return:		None
+* Description:
+*	Traces one query. Directions need not be unit length: the DDA
+*	works in multiples of the direction, so the range is divided
+*	by its length going in and distances multiplied by it coming
+*	out. A line of sight query uses the whole segment as its
+*	direction with a limit of 1.
+* --------------------------------- end RunQuery() ---- */
+HIDDEN void RunQuery(const QueryBatch *batch, int query){
+	double originX = batch->originX[query];
+	double originY = batch->originY[query];
+	double dirX = batch->towardX[query];
+	double dirY = batch->towardY[query];
+	RayQueryHit *result = &batch->hits[query];
+	ColumnHit hit;
+
+	if (batch->toTarget){
+		dirX -= originX;
+		dirY -= originY;
+	}
+	double length = sqrt(dirX * dirX + dirY * dirY);
+	double limit = batch->toTarget ? 1 : (batch->range != NULL ? batch->range[query] / length : INFINITY);
+
+	result->mapX = -1;
+	result->mapY = -1;
+	result->side = 0;
+	if (!(originX >= 0 && originY >= 0 && originX < world.sizeX && originY < world.sizeY)){
+		result->distance = 0;
+		result->hit = TRUE;
+		return;
+	}
+	if (length == 0 || !TraceRay(originX, originY, dirX, dirY, limit, &hit)){
+		result->distance = length == 0 ? 0 : limit * length;
+		result->hit = FALSE;
+		return;
+	}
+	result->distance = hit.perpWallDist * length;
+	result->mapX = hit.mapX;
+	result->mapY = hit.mapY;
+	result->side = hit.side;
+	result->hit = TRUE;
+}
+
+/* Run one tile of a sorted batch */
+HIDDEN void QueryTile(int tile, void *data){
+	const QueryBatch *batch = data;
+	int end = (tile + 1) * QUERY_TILE;
+	if (end > batch->count) end = batch->count;
+	for (int i = tile * QUERY_TILE; i < end; i++) RunQuery(batch, (int)(uint32_t)batch->order[i]);
+}
+
+/* ---- RunQueryBatch() ---------------------------------------
+* Parameters: 	batch to run
+* Type: 		Public
+* Return:		None
+* Description:
+*	Orders a batch and runs it over the worker pool. Batches of a
+*	single tile skip both and run in the order given.
+* --------------------------------- end RunQueryBatch() ---- */
+HIDDEN void RunQueryBatch(QueryBatch *batch){
+	if (batch->count <= QUERY_TILE){
+		for (int i = 0; i < batch->count; i++) RunQuery(batch, i);
+		return;
+	}
+	uint64_t *order = malloc(sizeof(uint64_t) * batch->count);
+	if (order == NULL){
+		for (int i = 0; i < batch->count; i++) RunQuery(batch, i);
+		return;
+	}
+	for (int i = 0; i < batch->count; i++){
+		double dirX = batch->towardX[i] - (batch->toTarget ? batch->originX[i] : 0);
+		double dirY = batch->towardY[i] - (batch->toTarget ? batch->originY[i] : 0);
+		order[i] = QueryKey(batch->originX[i], batch->originY[i], dirX, dirY) | (uint32_t)i;
+	}
+	qsort(order, batch->count, sizeof(uint64_t), CompareQueryKeys);
+	batch->order = order;
+	ParallelFor((batch->count + QUERY_TILE - 1) / QUERY_TILE, QueryTile, batch);
+	free(order);
+}
+
+/* ---- CastRayBatch() ---------------------------------------
+* Parameters: 	count origins and directions, ranges in cells
+*				(NULL = unlimited), count results
+* Type: 		Public
+* Return:		None
+* Description:
+*	Where does each ray meet a wall? hits[i] gets the first wall
+*	ray i enters within its range, the distance to where it enters
+*	it, and which side it came through.
+* --------------------------------- end CastRayBatch() ---- */
+void CastRayBatch(const double *originX, const double *originY, const double *dirX, const double *dirY, const double *range, int count, RayQueryHit *hits){
+	QueryBatch batch = {originX, originY, dirX, dirY, range, FALSE, count, NULL, hits};
+	RunQueryBatch(&batch);
+}
+
+/* ---- LineOfSightBatch() ---------------------------------------
+* Parameters: 	count origins and targets, count results
+* Type: 		Public
+* Return:		None
+* Description:
+*	Can each origin see its target? hits[i].hit is FALSE when no
+*	wall cell lies between them, otherwise it describes the first
+*	wall in the way. A target inside a wall is blocked by it.
+* --------------------------------- end LineOfSightBatch() ---- */
+void LineOfSightBatch(const double *originX, const double *originY, const double *targetX, const double *targetY, int count, RayQueryHit *hits){
+	QueryBatch batch = {originX, originY, targetX, targetY, NULL, TRUE, count, NULL, hits};
+	RunQueryBatch(&batch);
+}
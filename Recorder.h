@@ -0,0 +1,358 @@
+/**************************************************************
+* FILENAME:		Recorder.h
+*
+* DESCRIPTION:	-record: writes every frame shown to a raw YUV4MPEG2
+*				(.y4m) video file on a background thread.
+*
+* NOTES:		The main thread only copies a finished frame into one
+*				of RECORD_SLOTS preallocated buffers and queues it;
+*				the writer thread converts it to YUV 4:2:0 (BT.601,
+*				studio range; AVX2 where the CPU has it) and writes
+*				it out whole, through a RECORD_WRITE_BUFFER stdio
+*				buffer, so the disk sees large sequential writes.
+*				When every buffer is still waiting for the writer
+*				the frame is dropped and counted instead of waiting,
+*				so a slow disk never holds up rendering.
+*				The video is WINDOW_WIDTH x WINDOW_HEIGHT: frames
+*				rendered smaller by dynamic resolution are stretched
+*				to it (nearest pixel), like on screen. The overlay is
+*				not recorded. The header's frame rate is -limitfps,
+*				or RECORD_DEFAULT_FPS when frames are not limited to
+*				a sensible rate; frames are written as shown, so a
+*				pause waiting for input is not in the video.
+**************************************************************/
+
+#define RECORD_SLOTS		8			// frames that can wait for the writer
+#define RECORD_WRITE_BUFFER	(4 << 20)	// bytes of stdio buffer in front of the file
+#define RECORD_DEFAULT_FPS	60
+#define RECORD_MAX_FPS		240			// -limitfps above this counts as unlimited
+
+// The AVX2 conversion is built on any x86 target, like the palette expansion
+#if defined(__x86_64__) || defined(__i386__)
+#define RECORD_X86
+#include <immintrin.h>		// AVX2 (only used in functions built with target("avx2"))
+#endif
+
+// One frame waiting for the writer
+typedef struct {
+	Uint32 *pixels;			// room for WINDOW_WIDTH * WINDOW_HEIGHT, ARGB8888
+	int width;				// size the frame was rendered at
+	int height;
+} RecordSlot;
+
+// Recorder globals
+char *recordFile = NULL;		// set by -record
+FILE *recordOut = NULL;
+RecordSlot recordSlots[RECORD_SLOTS];
+int recordHead = 0;				// oldest queued slot
+int recordQueued = 0;			// slots waiting for the writer, the rest are free
+int recordQuit = FALSE;
+pthread_mutex_t recordMutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t recordReady = PTHREAD_COND_INITIALIZER;
+pthread_t recordThread;
+Uint8 *recordFrame = NULL;		// "FRAME\n" and the Y, U and V planes of the frame being written
+Uint32 *recordStretched = NULL;	// a smaller frame stretched to the video size
+size_t recordFrameBytes = 0;
+long recordedFrames = 0;
+long droppedFrames = 0;
+double recordWriteMs = 0;		// writer time spent converting and writing
+
+#define RECORD_FRAME_HEADER	"FRAME\n"
+
+/* BT.601 studio range from 8-bit RGB; the AVX2 path computes exactly the same */
+static inline Uint8 LumaOf(int r, int g, int b){
+	return (Uint8)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+}
+
+static inline Uint8 BlueDifferenceOf(int r, int g, int b){
+	return (Uint8)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+}
+
+static inline Uint8 RedDifferenceOf(int r, int g, int b){
+	return (Uint8)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+}
+
+/* Luma of pixels [from, count) of a row */
+HIDDEN void LumaRowScalar(Uint8 *out, const Uint32 *in, int from, int count){
+	for (int x = from; x < count; x++) out[x] = LumaOf((in[x] >> 16) & 0xFF, (in[x] >> 8) & 0xFF, in[x] & 0xFF);
+}
+
+/* Chroma samples [from, count) of a pair of rows, each the average of a 2x2 block (1x2 at an odd right edge) */
+HIDDEN void ChromaRowsScalar(Uint8 *u, Uint8 *v, const Uint32 *top, const Uint32 *bottom, int width, int from, int count){
+	for (int c = from; c < count; c++){
+		int x0 = 2 * c;
+		int x1 = x0 + 1 < width ? x0 + 1 : x0;
+		int r = 0, g = 0, b = 0;
+		Uint32 block[4] = {top[x0], top[x1], bottom[x0], bottom[x1]};
+		for (int i = 0; i < 4; i++){
+			r += (block[i] >> 16) & 0xFF;
+			g += (block[i] >> 8) & 0xFF;
+			b += block[i] & 0xFF;
+		}
+		r = (r + 2) >> 2;
+		g = (g + 2) >> 2;
+		b = (b + 2) >> 2;
+		u[c] = BlueDifferenceOf(r, g, b);
+		v[c] = RedDifferenceOf(r, g, b);
+	}
+}
+
+#ifdef RECORD_X86
+/* Eight 32-bit values (0-255) to eight bytes, in order */
+__attribute__((target("avx2")))
+static inline __m128i PackBytesAVX2(__m256i values){
+	__m256i words = _mm256_packus_epi32(values, values);	// per lane: v0-3 v0-3 | v4-7 v4-7
+	__m256i bytes = _mm256_packus_epi16(words, words);		// per lane: v0-3 x4 | v4-7 x4
+	return _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(bytes, _mm256_setr_epi32(0, 4, 0, 0, 0, 0, 0, 0)));
+}
+
+/* (cr * r + cg * g + cb * b + 128) >> 8, plus offset, for eight pixels */
+__attribute__((target("avx2")))
+static inline __m256i WeighAVX2(__m256i r, __m256i g, __m256i b, int cr, int cg, int cb, int offset){
+	__m256i sum = _mm256_add_epi32(_mm256_mullo_epi32(r, _mm256_set1_epi32(cr)), _mm256_mullo_epi32(g, _mm256_set1_epi32(cg)));
+	sum = _mm256_add_epi32(sum, _mm256_mullo_epi32(b, _mm256_set1_epi32(cb)));
+	sum = _mm256_srai_epi32(_mm256_add_epi32(sum, _mm256_set1_epi32(128)), 8);
+	return _mm256_add_epi32(sum, _mm256_set1_epi32(offset));
+}
+
+/* Luma of a row, eight pixels at a time */
+__attribute__((target("avx2")))
+void LumaRowAVX2(Uint8 *out, const Uint32 *in, int width){
+	__m256i mask = _mm256_set1_epi32(0xFF);
+	int x = 0;
+	for (; x + 8 <= width; x += 8){
+		__m256i pixels = _mm256_loadu_si256((const __m256i *)(in + x));
+		__m256i r = _mm256_and_si256(_mm256_srli_epi32(pixels, 16), mask);
+		__m256i g = _mm256_and_si256(_mm256_srli_epi32(pixels, 8), mask);
+		__m256i b = _mm256_and_si256(pixels, mask);
+		_mm_storel_epi64((__m128i *)(out + x), PackBytesAVX2(WeighAVX2(r, g, b, 66, 129, 25, 16)));
+	}
+	LumaRowScalar(out, in, x, width);
+}
+
+/* Sum of one channel over the 2x2 blocks of sixteen pixels of two rows, in block order */
+__attribute__((target("avx2")))
+static inline __m256i BlockSumsAVX2(__m256i top0, __m256i top1, __m256i bottom0, __m256i bottom1, int shift){
+	__m256i mask = _mm256_set1_epi32(0xFF);
+	__m256i first = _mm256_add_epi32(_mm256_and_si256(_mm256_srli_epi32(top0, shift), mask), _mm256_and_si256(_mm256_srli_epi32(bottom0, shift), mask));
+	__m256i second = _mm256_add_epi32(_mm256_and_si256(_mm256_srli_epi32(top1, shift), mask), _mm256_and_si256(_mm256_srli_epi32(bottom1, shift), mask));
+	__m256i sums = _mm256_hadd_epi32(first, second);	// per lane: first's pairs, second's pairs
+	return _mm256_permute4x64_epi64(sums, 0xD8);
+}
+
+/* Chroma of a pair of rows, eight samples (sixteen pixels) at a time */
+__attribute__((target("avx2")))
+void ChromaRowsAVX2(Uint8 *u, Uint8 *v, const Uint32 *top, const Uint32 *bottom, int width){
+	__m256i two = _mm256_set1_epi32(2);
+	int c = 0;
+	for (; 2 * c + 16 <= width; c += 8){
+		__m256i top0 = _mm256_loadu_si256((const __m256i *)(top + 2 * c));
+		__m256i top1 = _mm256_loadu_si256((const __m256i *)(top + 2 * c + 8));
+		__m256i bottom0 = _mm256_loadu_si256((const __m256i *)(bottom + 2 * c));
+		__m256i bottom1 = _mm256_loadu_si256((const __m256i *)(bottom + 2 * c + 8));
+		__m256i r = _mm256_srli_epi32(_mm256_add_epi32(BlockSumsAVX2(top0, top1, bottom0, bottom1, 16), two), 2);
+		__m256i g = _mm256_srli_epi32(_mm256_add_epi32(BlockSumsAVX2(top0, top1, bottom0, bottom1, 8), two), 2);
+		__m256i b = _mm256_srli_epi32(_mm256_add_epi32(BlockSumsAVX2(top0, top1, bottom0, bottom1, 0), two), 2);
+		_mm_storel_epi64((__m128i *)(u + c), PackBytesAVX2(WeighAVX2(r, g, b, -38, -74, 112, 128)));
+		_mm_storel_epi64((__m128i *)(v + c), PackBytesAVX2(WeighAVX2(r, g, b, 112, -94, -18, 128)));
+	}
+	ChromaRowsScalar(u, v, top, bottom, width, c, (width + 1) / 2);
+}
+#endif
+
+/* ---- ConvertFrame() ---------------------------------------
+* Parameters: 	pixels - a frame at the video size, out - its Y,
+*				U and V planes
+* Type: 		Public
+* Return:		None
+* Description:
+*	Converts a frame to planar YUV 4:2:0 a row (luma) or a pair
+*	of rows (chroma) at a time, while they are in cache. An odd
+*	last row or column is averaged with itself.
+* --------------------------------- end ConvertFrame() ---- */
+void ConvertFrame(const Uint32 *pixels, Uint8 *out){
+	int chromaWidth = (WINDOW_WIDTH + 1) / 2;
+	Uint8 *luma = out;
+	Uint8 *blue = luma + (size_t)WINDOW_WIDTH * WINDOW_HEIGHT;
+	Uint8 *red = blue + (size_t)chromaWidth * ((WINDOW_HEIGHT + 1) / 2);
+#ifdef RECORD_X86
+	static int avx2 = -1;
+	if (avx2 < 0) avx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+#endif
+
+	for (int y = 0; y < WINDOW_HEIGHT; y += 2){
+		const Uint32 *top = pixels + (size_t)y * WINDOW_WIDTH;
+		const Uint32 *bottom = y + 1 < WINDOW_HEIGHT ? top + WINDOW_WIDTH : top;
+		Uint8 *u = blue + (size_t)(y / 2) * chromaWidth;
+		Uint8 *v = red + (size_t)(y / 2) * chromaWidth;
+#ifdef RECORD_X86
+		if (avx2){
+			LumaRowAVX2(luma + (size_t)y * WINDOW_WIDTH, top, WINDOW_WIDTH);
+			if (bottom != top) LumaRowAVX2(luma + (size_t)(y + 1) * WINDOW_WIDTH, bottom, WINDOW_WIDTH);
+			ChromaRowsAVX2(u, v, top, bottom, WINDOW_WIDTH);
+			continue;
+		}
+#endif
+		LumaRowScalar(luma + (size_t)y * WINDOW_WIDTH, top, 0, WINDOW_WIDTH);
+		if (bottom != top) LumaRowScalar(luma + (size_t)(y + 1) * WINDOW_WIDTH, bottom, 0, WINDOW_WIDTH);
+		ChromaRowsScalar(u, v, top, bottom, WINDOW_WIDTH, 0, chromaWidth);
+	}
+}
+
+/* Stretch a frame rendered smaller than the video to its full size, nearest pixel */
+HIDDEN void StretchFrame(const RecordSlot *slot, Uint32 *out){
+	for (int y = 0; y < WINDOW_HEIGHT; y++){
+		const Uint32 *row = slot->pixels + (size_t)(y * slot->height / WINDOW_HEIGHT) * slot->width;
+		for (int x = 0; x < WINDOW_WIDTH; x++) *out++ = row[x * slot->width / WINDOW_WIDTH];
+	}
+}
+
+/* Writer thread: convert and write queued frames in order until told to stop and the queue is empty */
+HIDDEN void *RecordThreadMain(void *unused){
+	size_t header = strlen(RECORD_FRAME_HEADER);
+	for (;;){
+		pthread_mutex_lock(&recordMutex);
+		while (recordQueued == 0 && !recordQuit) pthread_cond_wait(&recordReady, &recordMutex);
+		if (recordQueued == 0){
+			pthread_mutex_unlock(&recordMutex);
+			return NULL;
+		}
+		RecordSlot *slot = &recordSlots[recordHead];
+		pthread_mutex_unlock(&recordMutex);
+
+		Uint64 start = SDL_GetPerformanceCounter();
+		const Uint32 *pixels = slot->pixels;
+		if (slot->width != WINDOW_WIDTH || slot->height != WINDOW_HEIGHT){
+			StretchFrame(slot, recordStretched);
+			pixels = recordStretched;
+		}
+		ConvertFrame(pixels, recordFrame + header);
+		fwrite(recordFrame, 1, recordFrameBytes, recordOut);
+		recordWriteMs += ElapsedMs(start, SDL_GetPerformanceCounter());
+
+		pthread_mutex_lock(&recordMutex);
+		recordHead = (recordHead + 1) % RECORD_SLOTS;
+		recordQueued--;
+		recordedFrames++;
+		pthread_mutex_unlock(&recordMutex);
+	}
+}
+
+HIDDEN void FreeRecordBuffers(){
+	for (int i = 0; i < RECORD_SLOTS; i++){
+		free(recordSlots[i].pixels);
+		recordSlots[i].pixels = NULL;
+	}
+	free(recordFrame);
+	free(recordStretched);
+	recordFrame = NULL;
+	recordStretched = NULL;
+}
+
+/* ---- StartRecording() ---------------------------------------
+* Parameters: 	None
+* Type: 		Public
+* Return:		TRUE if frames are being recorded to recordFile
+* Description:
+*	Opens the video, writes its header, allocates every buffer
+*	the recording will use and starts the writer thread. Call
+*	once WINDOW_WIDTH and WINDOW_HEIGHT are final.
+* --------------------------------- end StartRecording() ---- */
+bool StartRecording(){
+	size_t chroma = (size_t)((WINDOW_WIDTH + 1) / 2) * ((WINDOW_HEIGHT + 1) / 2);
+	recordFrameBytes = strlen(RECORD_FRAME_HEADER) + (size_t)WINDOW_WIDTH * WINDOW_HEIGHT + 2 * chroma;
+
+	recordFrame = malloc(recordFrameBytes);
+	recordStretched = malloc(sizeof(Uint32) * WINDOW_WIDTH * WINDOW_HEIGHT);
+	bool allocated = recordFrame != NULL && recordStretched != NULL;
+	for (int i = 0; i < RECORD_SLOTS; i++){
+		recordSlots[i].pixels = malloc(sizeof(Uint32) * WINDOW_WIDTH * WINDOW_HEIGHT);
+		if (recordSlots[i].pixels == NULL) allocated = FALSE;
+	}
+	if (!allocated){
+		printf("%s\n", "Out of memory for recording");
+		FreeRecordBuffers();
+		return FALSE;
+	}
+	memcpy(recordFrame, RECORD_FRAME_HEADER, strlen(RECORD_FRAME_HEADER));
+
+	recordOut = fopen(recordFile, "wb");
+	if (recordOut == NULL){
+		printf("%s%s\n", "Could not record to ", recordFile);
+		FreeRecordBuffers();
+		return FALSE;
+	}
+	setvbuf(recordOut, NULL, _IOFBF, RECORD_WRITE_BUFFER);
+	int fps = FPS_LIMIT > 0 && FPS_LIMIT <= RECORD_MAX_FPS ? FPS_LIMIT : RECORD_DEFAULT_FPS;
+	fprintf(recordOut, "YUV4MPEG2 W%i H%i F%i:1 Ip A1:1 C420jpeg\n", WINDOW_WIDTH, WINDOW_HEIGHT, fps);
+
+	recordHead = 0;
+	recordQueued = 0;
+	recordQuit = FALSE;
+	if (pthread_create(&recordThread, NULL, RecordThreadMain, NULL) != 0){
+		printf("%s\n", "Could not start the recording thread");
+		fclose(recordOut);
+		recordOut = NULL;
+		FreeRecordBuffers();
+		return FALSE;
+	}
+	printf("%s%s (%ix%i, %i fps)\n", "Recording: ", recordFile, WINDOW_WIDTH, WINDOW_HEIGHT, fps);
+	return TRUE;
+}
+
+/* ---- RecordFrame() ---------------------------------------
+* Parameters: 	pixels - a finished frame, its size
+* Type: 		Public
+* Return:		None
+* Description:
+*	Queues a copy of the frame for the writer, or drops it if
+*	every slot is still queued. The lock is only held to count
+*	slots, never while the writer converts or writes, so this
+*	costs one frame copy.
+* --------------------------------- end RecordFrame() ---- */
+void RecordFrame(const Uint32 *pixels, int width, int height){
+	if (recordOut == NULL) return;
+	pthread_mutex_lock(&recordMutex);
+	bool full = recordQueued == RECORD_SLOTS;
+	int tail = (recordHead + recordQueued) % RECORD_SLOTS;	// head and count move together, so read both under the lock
+	pthread_mutex_unlock(&recordMutex);
+	if (full){
+		droppedFrames++;
+		return;
+	}
+	// Only the writer frees slots, so this one stays free while it is filled
+	RecordSlot *slot = &recordSlots[tail];
+	memcpy(slot->pixels, pixels, sizeof(Uint32) * width * height);
+	slot->width = width;
+	slot->height = height;
+
+	pthread_mutex_lock(&recordMutex);
+	recordQueued++;
+	pthread_cond_signal(&recordReady);
+	pthread_mutex_unlock(&recordMutex);
+}
+
+/* ---- StopRecording() ---------------------------------------
+* Parameters: 	output file for the summary
+* Type: 		Public
+* Return:		None
+* Description:
+*	Lets the writer finish the frames already queued, closes the
+*	video and reports how many frames made it and how many were
+*	dropped.
+* --------------------------------- end StopRecording() ---- */
+void StopRecording(FILE *out){
+	if (recordOut == NULL) return;
+	pthread_mutex_lock(&recordMutex);
+	recordQuit = TRUE;
+	pthread_cond_signal(&recordReady);
+	pthread_mutex_unlock(&recordMutex);
+	pthread_join(recordThread, NULL);
+	fclose(recordOut);
+	recordOut = NULL;
+	FreeRecordBuffers();
+
+	fprintf(out, "%s%s%s%li%s%li%s", "Recording (", recordFile, "): ", recordedFrames, " frames written, ", droppedFrames, " dropped");
+	if (recordedFrames > 0) fprintf(out, "%s%.2f%s", ", writer busy ", recordWriteMs / recordedFrames, " ms per frame");
+	fprintf(out, "\n");
+}
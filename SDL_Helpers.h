@@ -1,7 +1,11 @@
 // Screen dimension defualts
 int SCREEN_WIDTH = 640; //640
 int SCREEN_HEIGHT = 480; //480
-int FPS_LIMIT = 999;
+// Window size; frames are rendered at SCREEN_WIDTH x SCREEN_HEIGHT, which is smaller with -target-ms
+int WINDOW_WIDTH = 640;
+int WINDOW_HEIGHT = 480;
+#define FPS_UNCAPPED 999	// FPS_LIMIT of this or more, or 0, means frames aren't paced at all
+int FPS_LIMIT = FPS_UNCAPPED;
 
 
 // Globals
@@ -9,35 +13,6 @@ SDL_Renderer *renderer;
 SDL_Event event;
 SDL_Window *window;
 
-void RenderBackground(){
-	int currentPartition;
-	int MAXpartition = 9; // must be odd for proper symmetry
-	int R = 60;
-	int G = 40;
-	int B = 0;
-	int x;
-	int y;
-	
-	for (currentPartition = 0; currentPartition < MAXpartition+1; currentPartition++){
-		for (x = 0; x < SCREEN_WIDTH; x++){
-			for (y = (SCREEN_HEIGHT/MAXpartition)*(currentPartition); y < (SCREEN_HEIGHT/MAXpartition)*(currentPartition+1); y++){
-				DrawPixel(ValidateColorRange(R), ValidateColorRange(G), ValidateColorRange(B), x, y);
-			}
-		}
-		if (currentPartition > (MAXpartition/2)-1){
-			R = R + 5;
-			G = G + 5;
-			B = B + 5;
-		}
-		else{
-			R = R - 5;
-			G = G - 5;
-			B = B - 5;
-		}
-
-	}
-}
-
 /* Assert acceptable color values */
 int ValidateColorRange(int color){
 	if (color > 255) color = 255;
@@ -51,6 +26,29 @@ void DrawPixel(int r, int g, int b, int x, int y){
 	SDL_RenderDrawPoint(renderer, x, y);
 }
 
+/* Wall color number (1 red, 2 green, 3 blue, 4 white, 5 yellow) for a map value */
+int WallColorNumber(int cell){
+	switch(cell){
+		case 1:	return 1; //red
+		case 2:	return 2; //green
+		case 3:	return 3; //blue
+		case 4:	return 4; //white
+		default: return 5; //yellow
+	}
+}
+
+/* Packed ARGB8888 color for a wall_color code (map value, +0.5 for darker y-sides) */
+Uint32 WallColor(double wall_color){
+	if (wall_color == 1.0)		return 0xFFFF0000; // red
+	else if (wall_color == 1.5)	return 0xFF820000; // reddish
+	else if (wall_color == 2.0)	return 0xFF00FF00; // green
+	else if (wall_color == 2.5)	return 0xFF008200; // greenish
+	else if (wall_color == 3.0)	return 0xFF0000FF; // blue
+	else if (wall_color == 3.5)	return 0xFF000082; // blueish
+	else if (wall_color == 5.0)	return 0xFFFFFF00; // yellow
+	else						return 0xFFFF8200; // orange
+}
+
 bool verLine(int x, int y1, int y2, double wall_color){
 	//swap y1 and y2
 	if(y2 < y1){
@@ -64,30 +62,8 @@ bool verLine(int x, int y1, int y2, double wall_color){
 
 	//printf("%lf\n", wall_color);
 
-	if (wall_color == 1.0){
-		SDL_SetRenderDrawColor(renderer, 255, 0, 0, 255); // draw in red color	
-	}
-	else if (wall_color == 1.5){
-		SDL_SetRenderDrawColor(renderer, 130, 0, 0, 255); // draw in reddish color	
-	}
-	else if (wall_color == 2.0){
-		SDL_SetRenderDrawColor(renderer, 0, 255, 0, 255); // draw in green color	
-	}
-	else if (wall_color == 2.5){
-		SDL_SetRenderDrawColor(renderer, 0, 130, 0, 255); // draw in greenish color	
-	}
-	else if (wall_color == 3.0){
-		SDL_SetRenderDrawColor(renderer, 0, 0, 255, 255); // draw in blue color	
-	}
-	else if (wall_color == 3.5){
-		SDL_SetRenderDrawColor(renderer, 0, 0, 130, 255); // draw in blueish color	
-	}
-	else if (wall_color == 5.0){
-		SDL_SetRenderDrawColor(renderer, 255, 255, 0, 255); // draw in yellow color	
-	}
-	else{
-		SDL_SetRenderDrawColor(renderer, 255, 130, 0, 255); // draw in yellow color	
-	}
+	Uint32 color = WallColor(wall_color);
+	SDL_SetRenderDrawColor(renderer, (color >> 16) & 0xFF, (color >> 8) & 0xFF, color & 0xFF, 255);
 
 
 	int bufp;
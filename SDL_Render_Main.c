@@ -20,15 +20,48 @@
 #include "stdio.h"		// Required standard IO libraries
 #include "pthread.h"	// multithreading support
 #include "const.h"		// personal set of constants
-#include "map1.h"
+#include "map1.h"			// compiled-in default map, used when no -map file is given
+#include "MapLoader.h"
 #include "SDL_Helpers.h"
+#include "Framebuffer.h"
+#include "RayKernel.h"
+#include "Textures.h"
+#include "Palette.h"
+#include "Bench.h"
+#include "Movement.h"
+#include "Profiler.h"
+#include "FramePacing.h"
+#include "PlayerThread.h"
+#include "FramePipeline.h"
+#include "DynamicResolution.h"
+#include "Floors.h"
+#include "Sprites.h"
+#include "ViewCache.h"
+#include "MapEdit.h"
+#include "WorkerPool.h"
+#include "RayQuery.h"
+#include "Recorder.h"
+#include "BatchRender.h"
 
 // Function Declarations
 void CheckForInput();
+void StepPlayer(CameraState *state, double dt, int keys);
 void RayCast();
+void RenderFrame(FrameTiming *timing);
+void ShowFrame(const Uint32 *pixels, int width, int height, FrameTiming *timing);
+void ProduceFrame(PipelineSlot *slot);
+void RunPipelined(int frames);
+void CastColumnTile(int tile, void *unused);
+void DrawColumnTile(int tile, void *unused);
+void DrawColumn(int x, const ColumnHit *hit);
+int CalibrateRayKernel(int widest);
+int CalibrateRayGrid();
+Uint64 TimeOpeningView();
+void RunBench();
+int CheckPrecision();
 
 // Position Globals
-double positionInfo[11]	= {3.0, 6.0, -1.0, 0.0, 0.0, 0.66, 0.0, 0.0, FALSE, 0.1, 0.1};
+double positionInfo[11]	= {3.0, 6.0, -1.0, 0.0, 0.0, 0.66, 0.0, 0.0, FALSE, 3.0, 3.0};
 double *playerPosX 		= &positionInfo[0];
 double *playerPosY 		= &positionInfo[1];
 double *playerDirX 		= &positionInfo[2];
@@ -38,10 +71,18 @@ double *planeY 			= &positionInfo[5];
 double *currentFrame 	= &positionInfo[6];
 double *lastFrame 		= &positionInfo[7];
 double *readyToQuit 	= &positionInfo[8];
-double *moveSpeed 		= &positionInfo[9];
-double *rotSpeed 		= &positionInfo[10];
+double *moveSpeed 		= &positionInfo[9];	// cells per second
+double *rotSpeed 		= &positionInfo[10];	// radians per second
 
 int displayFPS = FPS_OFF; // don't show FPS unless specified via arguments
+char *mapFile = NULL;		// -map file, NULL = compiled-in map
+bool checkPrecision = FALSE;	// -checkprecision: compare against the double kernel instead of timing
+
+// Columns per worker tile: 16 ARGB pixels fill one 64-byte cache line, so
+// two threads never write the same line of a framebuffer row
+#define COLUMNS_PER_TILE	16
+
+ColumnHit *columnHits;	// what each screen column's ray hit this frame
 
 /* ---- main() ---------------------------------------
 * Parameters: 	Various Arguments (see ReadMe.MD)
@@ -87,30 +128,218 @@ int main(int argc, char *argv[]){
 			else FPS_LIMIT  =  atoi(argv[i+1]);
 			printf("%s%i\n", "FPS limit: ", FPS_LIMIT);
 		}
+		else if (!strcmp(argv[i], "-target-ms") && (i+1) < argc){
+			if (isdigit(argv[i+1][0])) targetFrameMs = atof(argv[i+1]);
+		}
+		else if (!strcmp(argv[i], "-min-scale") && (i+1) < argc){
+			if (isdigit(argv[i+1][0])) minRenderScale = atof(argv[i+1]);
+			if (minRenderScale <= 0 || minRenderScale > 1) minRenderScale = 0.5;
+		}
+		else if (!strcmp(argv[i], "-framebuffer") && (i+1) < argc){
+			if (!strcmp(argv[i+1], "0")){
+				printf("%s\n", "Rendering with per-column draw calls");
+				renderMode = RENDER_DRAWCALLS;
+			}
+			else if (!strcmp(argv[i+1], "8")){
+				printf("%s\n", "Rendering into an 8-bit indexed framebuffer");
+				renderMode = RENDER_INDEXED;
+			}
+		}
+		else if (!strcmp(argv[i], "-pipeline") && (i+1) < argc){
+			if (!strcmp(argv[i+1], "latency")) pipelineMode = PIPELINE_LATENCY;
+			else if (!strcmp(argv[i+1], "throughput")) pipelineMode = PIPELINE_THROUGHPUT;
+		}
+		else if (!strcmp(argv[i], "-threads") && (i+1) < argc){
+			if (isdigit(argv[i+1][0])) threadCount = atoi(argv[i+1]);
+		}
+		else if (!strcmp(argv[i], "-simd") && (i+1) < argc){
+			if (!strcmp(argv[i+1], "off")) rayKernel = KERNEL_SCALAR;
+			else if (!strcmp(argv[i+1], "sse2")) rayKernel = KERNEL_SSE2;
+			else if (!strcmp(argv[i+1], "avx2")) rayKernel = KERNEL_AVX2;
+		}
+		else if (!strcmp(argv[i], "-skip") && (i+1) < argc){
+			if (!strcmp(argv[i+1], "off")) emptySkip = SKIP_OFF;
+			else if (!strcmp(argv[i+1], "on")) emptySkip = SKIP_ON;
+		}
+		else if (!strcmp(argv[i], "-grid") && (i+1) < argc){
+			if (!strcmp(argv[i+1], "cells")) rayGrid = GRID_CELLS;
+			else if (!strcmp(argv[i+1], "morton")) rayGrid = GRID_MORTON;
+		}
+		else if (!strcmp(argv[i], "-textures") && (i+1) < argc){
+			if (!strcmp(argv[i+1], "off")) texturesEnabled = FALSE;
+			else textureFile = argv[i+1];
+		}
+		else if (!strcmp(argv[i], "-viewcache") && (i+1) < argc){
+			if (!strcmp(argv[i+1], "off")) viewCacheEnabled = FALSE;
+		}
+		else if (!strcmp(argv[i], "-floors") && (i+1) < argc){
+			if (!strcmp(argv[i+1], "off")) floorsEnabled = FALSE;
+		}
+		else if (!strcmp(argv[i], "-sprites") && (i+1) < argc){
+			spriteRequest = atoi(argv[i+1]);
+		}
+		else if (!strcmp(argv[i], "-edits") && (i+1) < argc){
+			editsPerFrame = atoi(argv[i+1]);
+		}
+		else if (!strcmp(argv[i], "-map") && (i+1) < argc){
+			mapFile = argv[i+1];
+		}
+		else if (!strcmp(argv[i], "-bench") && (i+1) < argc){
+			benchPathFile = argv[i+1];
+		}
+		else if (!strcmp(argv[i], "-frames") && (i+1) < argc){
+			if (isdigit(argv[i+1][0])) benchFrames = atoi(argv[i+1]);
+		}
+		else if (!strcmp(argv[i], "-benchout") && (i+1) < argc){
+			benchOutFile = argv[i+1];
+		}
+		else if (!strcmp(argv[i], "-checkprecision")){
+			checkPrecision = TRUE;
+		}
+		else if (!strcmp(argv[i], "-telemetry") && (i+1) < argc){
+			OpenTelemetry(argv[i+1]);
+		}
+		else if (!strcmp(argv[i], "-recordpath") && (i+1) < argc){
+			recordPath = fopen(argv[i+1], "w");
+			if (recordPath == NULL) printf("%s%s\n", "Could not record camera path to ", argv[i+1]);
+		}
+		else if (!strcmp(argv[i], "-record") && (i+1) < argc){
+			recordFile = argv[i+1];
+		}
+
 
+	}
 
+	/* Load the world; start at its spawn point if the default position is inside a wall */
+	if (mapFile != NULL){
+		if (!LoadMapFile(mapFile)) return EXIT_FAILURE;
+		printf("%s%s (%ix%i)\n", "Map: ", mapFile, world.sizeX, world.sizeY);
+	}
+	else{
+		if (!LoadCompiledMap(&worldMap[0][0], WORLD_HEIGHT, WORLD_WIDTH)) return EXIT_FAILURE;
+	}
+	if (*playerPosX < 1 || *playerPosY < 1 || *playerPosX >= world.sizeX - 1 || *playerPosY >= world.sizeY - 1
+		|| WORLD_CELL((int)*playerPosX, (int)*playerPosY) != EMPTYSPACE){
+		*playerPosX = world.spawnX + 0.5;
+		*playerPosY = world.spawnY + 0.5;
+	}
+
+	/* Benchmarks replay a camera path offscreen */
+	if (benchPathFile != NULL){
+		if (!LoadCameraPath(benchPathFile)) return EXIT_FAILURE;
+		ApplyCameraState(&benchPath[0], positionInfo);
+		SDL_setenv("SDL_VIDEODRIVER", "dummy", 0); // no window unless a driver is forced
+		displayFPS = FPS_OFF;
 	}
 
 	/* Setup libraries and create window */
 	SDL_Init(SDL_INIT_VIDEO);
 	TTF_Init();
 
-	SDL_CreateWindowAndRenderer(SCREEN_WIDTH, SCREEN_HEIGHT, SDL_WINDOW_OPENGL, &window, &renderer);
-	RenderBackground();
+	WINDOW_WIDTH = SCREEN_WIDTH; // frames start at full resolution
+	WINDOW_HEIGHT = SCREEN_HEIGHT;
+	if (benchPathFile != NULL){
+		window = SDL_CreateWindow("Pseudo-3D-SDL benchmark", 0, 0, WINDOW_WIDTH, WINDOW_HEIGHT, SDL_WINDOW_HIDDEN);
+		renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_SOFTWARE);
+	}
+	else{
+		SDL_CreateWindowAndRenderer(WINDOW_WIDTH, WINDOW_HEIGHT, SDL_WINDOW_OPENGL, &window, &renderer);
+	}
+	columnHits = malloc(sizeof(ColumnHit) * WINDOW_WIDTH);
+	if (viewCacheEnabled && !CreateViewCache()) printf("%s\n", "Out of memory for the view cache, recasting turned views");
+	if (renderMode != RENDER_DRAWCALLS && (!CreateFramebuffer() || (renderMode == RENDER_INDEXED && !CreateIndexedBuffer()))){
+		printf("%s\n", "Falling back to per-column draw calls");
+		DestroyFramebuffer();
+		DestroyIndexedBuffer();
+		renderMode = RENDER_DRAWCALLS;
+	}
+	if (displayFPS == FPS_WINDOW && !CreateGlyphAtlas("opensans.ttf")) printf("%s\n", "Showing the frame time graph without text");
+	/* Textured walls are drawn into the framebuffer only; a missing atlas falls back to the built-in set */
+	if (renderMode == RENDER_FRAMEBUFFER && texturesEnabled){
+		if (textureFile == NULL || !LoadTextureAtlas(textureFile)) GenerateTextures();
+		if (textureAtlas != NULL) printf("%s%i\n", "Wall textures: ", textureCount);
+	}
+	/* Framebuffer frames cast the floor every frame, draw calls copy a fixed background */
+	if (floorsEnabled && (!CreateFloors() || (renderMode == RENDER_DRAWCALLS && !CreateBackground()))){
+		printf("%s\n", "Could not set up floors, drawing a black background");
+		floorsEnabled = FALSE;
+	}
+	clearAroundWalls = !floorsEnabled;
+	/* Sprites are drawn into the framebuffer over the walls */
+	if (spriteRequest > 0 && renderMode == RENDER_DRAWCALLS) printf("%s\n", "Sprites need a framebuffer, not drawing them");
+	else if (spriteRequest > 0 && !CreateSprites(spriteRequest)) printf("%s\n", "Out of memory for sprites, not drawing them");
+	else if (spriteRequest > 0) printf("%s%i\n", "Sprites: ", ScatterSprites(spriteRequest));
+
+	/* SDL draw calls must stay on this thread, so only the framebuffer path is split up */
+	if (renderMode != RENDER_DRAWCALLS) CreateWorkerPool(threadCount);
+	else threadCount = 1;
+	if (renderMode == RENDER_DRAWCALLS) pipelineMode = PIPELINE_OFF; // draw calls can't leave the main thread
+	if (pipelineMode != PIPELINE_OFF) printf("%s%s\n", "Frame pipeline: ", pipelineModeNames[pipelineMode]);
+	/* Only a framebuffer can be stretched over the window */
+	if (renderMode == RENDER_DRAWCALLS || !CreateResolutionTables()) targetFrameMs = 0;
+	if (targetFrameMs > 0) printf("%s%.2f%s%.0f%s\n", "Dynamic resolution: ", targetFrameMs, " ms per frame, down to ", 100.0 * minRenderScale, "%");
+	printf("%s%i\n", "Render threads: ", threadCount);
+	/* Frames are recorded from the framebuffer as they are shown */
+	if (recordFile != NULL && renderMode == RENDER_DRAWCALLS) printf("%s\n", "Recording needs a framebuffer, not recording");
+	else if (recordFile != NULL) StartRecording();
+	InitRayPrecision();
+	printf("%s%s\n", "Ray precision: ", rayPrecisionNames[RAY_PRECISION]);
+	/* Empty-space skipping needs the distance field; with -skip auto it has to win calibration too */
+	if (RAY_PRECISION == RAY_DOUBLE && (emptySkip == SKIP_ON || (emptySkip == SKIP_AUTO && rayKernel == KERNEL_AUTO))){
+		if (!BuildDistanceField()) printf("%s\n", "Out of memory for the distance field, not skipping empty space");
+	}
+	/* Kernels are timed in the byte cells, then -grid auto times the chosen one in both grids */
+	rayGrid = SelectRayGrid(rayGrid);
+	if (emptySkip == SKIP_ON) rayKernel = SelectRayKernel(KERNEL_SKIP);
+	else if (rayKernel == KERNEL_AUTO) rayKernel = CalibrateRayKernel(SelectRayKernel(KERNEL_AUTO));
+	else rayKernel = SelectRayKernel(rayKernel);
+	if (rayGrid == GRID_AUTO) rayGrid = CalibrateRayGrid();
+	printf("%s%s\n", "Ray kernel: ", rayKernelNames[rayKernel]);
+	printf("%s%s\n", "Ray grid: ", rayGridNames[rayGrid]);
 
 	/* Rendering/Input Loop */
-	while (*readyToQuit != TRUE){
+	int status = EXIT_SUCCESS;
+	if (benchPathFile != NULL && checkPrecision) status = CheckPrecision() ? EXIT_SUCCESS : EXIT_FAILURE;
+	else if (benchPathFile != NULL) RunBench();
+	if (benchPathFile == NULL) StartPlayerThread(StepPlayer, positionInfo);
+	if (benchPathFile == NULL && pipelineMode != PIPELINE_OFF) RunPipelined(0);
+	while (benchPathFile == NULL && *readyToQuit != TRUE){
+		Uint64 inputStart = SDL_GetPerformanceCounter();
 		CheckForInput();
+		frameTiming.input = ElapsedMs(inputStart, SDL_GetPerformanceCounter());
+		LatestCamera(positionInfo);
+		if (recordPath != NULL) RecordCameraState(recordPath, positionInfo);
+		if (editsPerFrame > 0) EditRandomCells(editsPerFrame, (int)*playerPosX, (int)*playerPosY);
 		RayCast();
-		//sleep( 16.66666666 );
+		if (frameTiming.cached >= 1 && heldKeys == 0 && !MapEditsPending()) WaitForInput(); // nothing on screen can change until a key does
+		else PaceFrame(FPS_LIMIT);
 	}
 
 	/* Cleanly exit */
+	StopPlayerThread();
+	if (benchPathFile == NULL || !checkPrecision) ReportViewCache(stdout);
+	ReportSprites(stdout);
+	ReportMapEdits(stdout);
+	StopRecording(stdout);
+	if (recordPath != NULL) fclose(recordPath);
+	CloseTelemetry();
+	DestroyGlyphAtlas();
+	free(columnHits);
+	DestroyFloors();
+	DestroySprites();
+	FreeMapEdits();
+	DestroyViewCache();
+	DestroyResolutionTables();
+	FreeWorldMap();
+	FreeTextures();
+	DestroyWorkerPool();
+	DestroyFramebuffer();
+	DestroyIndexedBuffer();
 	SDL_DestroyRenderer(renderer);
 	SDL_DestroyWindow(window);
 	TTF_Quit();
 	SDL_Quit();
-	return EXIT_SUCCESS;
+	return status;
 	
 }
 
@@ -122,145 +351,438 @@ int main(int argc, char *argv[]){
 *	Renders an entire frame using a traditional raycasting algorithm
 *	We'll fill the window with the rendered frame and update accordingly
 *		Pixels are placed in vertical rows
+*	Without -pipeline both halves run back to back on this thread.
 * --------------------------------- end RayCast() ---- */
 void RayCast(){
-	Uint32 start_time = SDL_GetTicks(); // Get time at start to determine how long it takes to render
-
-	/* Render one vertical line at a time */
-	for(int x = 0; x < SCREEN_WIDTH; x++){
-		// Calculate ray position and direction
-		double cameraX = 2 * x / ((double)(SCREEN_WIDTH) - 1); // x-coordinate in camera space
-		double rayDirX = *playerDirX + *planeX * cameraX;
-		double rayDirY = *playerDirY + *planeY * cameraX;
-		// Which box of the map we're in
-			// We only need double precision for rendering calculations.
-			// It's safe to round off here to figure out which box's boundaries we're within
-		int mapX = (int) *playerPosX;
-		int mapY = (int) *playerPosY;
-		// Length of ray from current position to next x or y-side
-		double sideDistX;
-		double sideDistY;
-		 // Length of ray from one side to the next
-		double deltaDistX = fabs(1 / rayDirX);
-		double deltaDistY = fabs(1 / rayDirY);
-		double perpWallDist;
-		// What direction to step in x or y-direction (either +1 or -1)
-		int stepX;
-		int stepY;
-		int hit = 0;	// was there a wall hit?
-		int side; 		// which side was hit?
-		// Calculate step and initial sideDist
-		if (rayDirX < 0){
-			stepX = -1;
-			sideDistX = (*playerPosX - mapX) * deltaDistX;
-		}
-		else{
-			stepX = 1;
-			sideDistX = (mapX + 1.0 - *playerPosX) * deltaDistX;
-		}
-		if (rayDirY < 0){
-			stepY = -1;
-			sideDistY = (*playerPosY - mapY) * deltaDistY;
-		}
-		else{
-			stepY = 1;
-			sideDistY = (mapY + 1.0 - *playerPosY) * deltaDistY;
-		}
-		/* Simple Digital Differential Analysis Algorithm */
-		// determines distance to next grid line, so that we can check if a wall's there
-		while (hit == 0){
-			// Jump to next map square, OR in x-direction, OR in y-direction
-			if (sideDistX < sideDistY){
-				sideDistX += deltaDistX;
-				mapX += stepX;
-				side = 0;
-			}
-			else{
-				sideDistY += deltaDistY;
-				mapY += stepY;
-				side = 1;
-			}
-			// Check if ray has hit a wall (or out of bounds)
-			if (worldMap[mapX][mapY] > 0) hit = 1;
-		}
-		// Calculate distance projected on camera direction
-		if (side == 0){
-			perpWallDist = (mapX - *playerPosX + (1 - stepX) / 2) / rayDirX;
-		}
-		else{
-			perpWallDist = (mapY - *playerPosY + (1 - stepY) / 2) / rayDirY;
+	RenderFrame(&frameTiming);
+	ShowFrame(frameBuffer, SCREEN_WIDTH, SCREEN_HEIGHT, &frameTiming);
+}
+
+/* ---- RenderFrame() ---------------------------------------
+* Parameters: 	timing - receives the cast and draw times
+* Type: 		Public
+* Return:		None
+* Description:
+*	Casts and draws a frame from the camera in positionInfo into
+*	frameBuffer (or, with draw calls, the renderer). Framebuffer
+*	modes make no SDL calls here, so with -pipeline this runs on
+*	the render thread.
+*	An unchanged view is not cast again, and not drawn again
+*	either if frameBuffer still holds it and no sprite has changed
+*	since (see ViewCache.h).
+*	The frame is rendered at the resolution the dynamic resolution
+*	controller last asked for (see DynamicResolution.h).
+*	Map edits queued since the last frame are applied first, and
+*	count as cast time (see MapEdit.h).
+* --------------------------------- end RenderFrame() ---- */
+void RenderFrame(FrameTiming *timing){
+	Uint64 frameStart = SDL_GetPerformanceCounter();
+	ApplyMapEdits();
+	timing->scale = ApplyRenderScale();
+	int tiles = (SCREEN_WIDTH + COLUMNS_PER_TILE - 1) / COLUMNS_PER_TILE;
+	CameraState camera = {*playerPosX, *playerPosY, *playerDirX, *playerDirY, *planeX, *planeY};
+	long reusedBefore = reusedColumns;
+	int view = BeginViewFrame(&camera, &columnHits);
+	bool cast = view != VIEW_UNCHANGED;	// otherwise columnHits already hold this view
+	bool draw = cast || renderMode == RENDER_DRAWCALLS || frameBuffer != cachedPixels || spriteRevision != drawnSpriteRevision;
+
+	/* Cast one ray per vertical line, then draw the lines */
+		// Every column is independent, so the framebuffer path spreads
+		// tiles of columns over the worker pool
+	if (cast && renderMode != RENDER_DRAWCALLS){
+		ParallelFor(tiles, CastColumnTile, NULL);
+	}
+	else if (cast){
+		for(int tile = 0; tile < tiles; tile++) CastColumnTile(tile, NULL);
+	}
+	Uint64 castEnd = SDL_GetPerformanceCounter();
+
+	if (draw && renderMode != RENDER_DRAWCALLS){
+		if (floorsEnabled) ParallelFor(PrepareFloors(&camera), FloorBand, NULL);
+		if (spriteCount > 0) PrepareSprites(&camera, columnHits);
+		ParallelFor(tiles, DrawColumnTile, NULL);
+		if (renderMode == RENDER_INDEXED) ParallelFor((SCREEN_HEIGHT + EXPAND_ROWS - 1) / EXPAND_ROWS, ExpandRows, NULL);
+	}
+	else if (draw){
+		if (floorsEnabled) DrawBackground();
+		for(int tile = 0; tile < tiles; tile++) DrawColumnTile(tile, NULL);
+	}
+	Uint64 drawEnd = SDL_GetPerformanceCounter();
+	EndViewFrame(renderMode != RENDER_DRAWCALLS ? frameBuffer : NULL);
+
+	timing->cast = ElapsedMs(frameStart, castEnd);
+	timing->draw = ElapsedMs(castEnd, drawEnd);
+	timing->steps = 0;
+	if (cast){
+		for (int x = 0; x < SCREEN_WIDTH; x++) timing->steps += columnHits[x].steps;
+		timing->steps /= SCREEN_WIDTH;
+	}
+	timing->cached = (double)(reusedColumns - reusedBefore) / SCREEN_WIDTH;
+}
+
+/* ---- ShowFrame() ---------------------------------------
+* Parameters: 	pixels - rendered frame, its size, timing - its
+*				stage times
+* Type: 		Public
+* Return:		None
+* Description:
+*	Uploads a rendered frame (and hands it to -record), draws the overlay over it and
+*	presents it, then records its timings. Always on the main
+*	thread. When pipelined, stages overlap, so a frame's total is
+*	the time since the previous frame was shown instead of the sum
+*	of its stages.
+* --------------------------------- end ShowFrame() ---- */
+void ShowFrame(const Uint32 *pixels, int width, int height, FrameTiming *timing){
+	static Uint64 lastShown = 0;
+	Uint64 showStart = SDL_GetPerformanceCounter();
+
+	/* Hand the whole frame to SDL at once; the overlay is drawn on top of it */
+	if (renderMode != RENDER_DRAWCALLS) PresentFramebuffer(pixels, width, height);
+	RecordFrame(pixels, width, height);
+	Uint64 uploadEnd = SDL_GetPerformanceCounter();
+
+	/* timing for the FPS counter */
+	double frameTime = timing->cast + timing->draw; // time spent rendering this frame, in milliseconds
+
+	/* The overlay shows the last complete frame: this one is still being presented */
+	Uint64 overlayStart = SDL_GetPerformanceCounter();
+	if (displayFPS == FPS_WINDOW){
+		DrawProfilerOverlay();
+	}
+
+	if (displayFPS == FPS_TERMINAL){
+		printf("%.2f ms\n", frameTime);
+	}
+	Uint64 overlayEnd = SDL_GetPerformanceCounter();
+
+	SDL_RenderPresent(renderer); // Display what we just made
+
+	/* Every frame starts with a black background
+		It will be overwritten with actual data */
+	if (renderMode == RENDER_DRAWCALLS){
+		SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+		SDL_RenderClear(renderer);
+	}
+	Uint64 frameEnd = SDL_GetPerformanceCounter();
+
+	timing->overlay = ElapsedMs(overlayStart, overlayEnd);
+	timing->present = ElapsedMs(showStart, uploadEnd) + ElapsedMs(overlayEnd, frameEnd);
+	timing->total = timing->input + timing->cast + timing->draw + timing->overlay + timing->present;
+	if (pipelineMode != PIPELINE_OFF && lastShown != 0) timing->total = ElapsedMs(lastShown, frameEnd);
+	lastShown = frameEnd;
+	frameTiming = *timing;
+	RecordFrameTiming(timing);
+	MeasureFrameScale(timing);
+}
+
+/* Render thread side of -pipeline: take the frame's camera, then render into the slot */
+void ProduceFrame(PipelineSlot *slot){
+	if (benchPathFile != NULL) ApplyCameraState(&benchPath[slot->frame % benchPathLength], positionInfo);
+	else LatestCamera(positionInfo);
+	if (recordPath != NULL) RecordCameraState(recordPath, positionInfo);
+	frameBuffer = slot->pixels;
+	RenderFrame(&slot->timing);
+	slot->width = SCREEN_WIDTH;
+	slot->height = SCREEN_HEIGHT;
+}
+
+/* ---- RunPipelined() ---------------------------------------
+* Parameters: 	frames - how many to show, 0 = until quitting
+* Type: 		Public
+* Return:		None
+* Description:
+*	Main thread side of -pipeline: polls input and shows frames
+*	as the render thread finishes them, keeping the frame rate
+*	limit. Frames go into benchTimings when benchmarking.
+* --------------------------------- end RunPipelined() ---- */
+void RunPipelined(int frames){
+	Uint32 *ownBuffer = frameBuffer; // slots take its place while the pipeline runs
+
+	if (!StartPipeline(pipelineMode, ProduceFrame)){
+		pipelineMode = PIPELINE_OFF;
+		return;
+	}
+	for (int frame = 0; frames == 0 ? *readyToQuit != TRUE : frame < frames; frame++){
+		Uint64 inputStart = SDL_GetPerformanceCounter();
+		if (benchPathFile == NULL) CheckForInput();
+		double input = ElapsedMs(inputStart, SDL_GetPerformanceCounter());
+		if (editsPerFrame > 0) EditRandomCells(editsPerFrame, (int)*playerPosX, (int)*playerPosY);
+
+		PipelineSlot *slot = AcquireFrame();
+		slot->timing.input = input;
+		ShowFrame(slot->pixels, slot->width, slot->height, &slot->timing);
+		if (benchTimings != NULL) benchTimings[frame] = slot->timing;
+		bool idle = slot->timing.cached >= 1 && heldKeys == 0 && !MapEditsPending();
+		ReleaseFrame(slot);
+		if (benchPathFile == NULL && idle) WaitForInput();
+		else if (benchPathFile == NULL) PaceFrame(FPS_LIMIT);
+	}
+	StopPipeline();
+	frameBuffer = ownBuffer;
+	ReportPipeline(stdout);
+}
+
+/* ---- CastColumnTile() ---------------------------------------
+* Parameters: 	tile - index of a group of COLUMNS_PER_TILE columns
+* Type: 		Public
+* Return:		None
+* Description:
+*	Casts the rays for one tile of adjacent screen columns into
+*	columnHits. Only reads the player state, so tiles can run on
+*	any thread in framebuffer mode.
+*	Adjacent rays are cast together so the SIMD kernels can
+*	step them as packets. With textured walls the texture
+*	column is worked out here too, while the ray is at hand.
+*	When the camera only turned, or stayed put while the map was
+*	edited, columns the last frame's hits can answer are not cast;
+*	the rest are cast as one packet.
+* --------------------------------- end CastColumnTile() ---- */
+void CastColumnTile(int tile, void *unused){
+	double rayDirX[COLUMNS_PER_TILE];
+	double rayDirY[COLUMNS_PER_TILE];
+	int first = tile * COLUMNS_PER_TILE;
+	int count = SCREEN_WIDTH - first;
+	if (count > COLUMNS_PER_TILE) count = COLUMNS_PER_TILE;
+
+	// Calculate ray position and direction
+	for (int i = 0; i < count; i++){
+		double cameraX = ColumnCameraX(first + i); // x-coordinate in camera space
+		rayDirX[i] = *playerDirX + *planeX * cameraX;
+		rayDirY[i] = *playerDirY + *planeY * cameraX;
+	}
+	int reusedCount = 0;
+	bool reused[COLUMNS_PER_TILE];
+	if (viewState == VIEW_TURNED) reusedCount = ReuseTurnedColumns(rayDirX, rayDirY, count, columnHits + first, reused);
+	else if (viewState == VIEW_EDITED) reusedCount = ReuseUneditedColumns(rayDirX, rayDirY, count, columnHits + first, reused);
+	if (reusedCount == 0){
+		CastRays(*playerPosX, *playerPosY, rayDirX, rayDirY, count, columnHits + first);
+	}
+	else{
+		double castDirX[COLUMNS_PER_TILE];
+		double castDirY[COLUMNS_PER_TILE];
+		ColumnHit castHits[COLUMNS_PER_TILE];
+		int cast = 0;
+		for (int i = 0; i < count; i++){
+			if (reused[i]) continue;
+			castDirX[cast] = rayDirX[i];
+			castDirY[cast] = rayDirY[i];
+			cast++;
 		}
-		// Calculate height of line to draw on screen
-		int lineHeight = (int)(SCREEN_HEIGHT / perpWallDist);
-		// Calculate the beginning and end positions of the line
-		int drawStart = -lineHeight / 2 + SCREEN_HEIGHT / 2;
-		if(drawStart < 0)drawStart = 0;
-		int drawEnd = lineHeight / 2 + SCREEN_HEIGHT / 2;
-		if(drawEnd >= SCREEN_HEIGHT)drawEnd = SCREEN_HEIGHT - 1;
-		// Choose wall color
-		double wall_color;
-		switch(worldMap[mapX][mapY]){
-			case 1:	wall_color = 1;		break; //red
-			case 2:	wall_color = 2;		break; //green
-			case 3:	wall_color = 3; 	break; //blue
-			case 4:	wall_color = 4;		break; //white
-			default: wall_color = 5;	break; //yellow
+		if (cast > 0) CastRays(*playerPosX, *playerPosY, castDirX, castDirY, cast, castHits);
+		for (int i = 0, next = 0; i < count; i++){
+			if (!reused[i]) columnHits[first + i] = castHits[next++];
 		}
-		// Give x and y sides different brightness
-		if (side == 1) {wall_color = wall_color + 0.5;}
-		// Draw the vertical line associated with this array
-		verLine(x, drawStart, drawEnd, wall_color);
+		CountReusedColumns(reusedCount);
 	}
+	if (textureAtlas != NULL){
+		for (int i = 0; i < count; i++) columnHits[first + i].texX = TextureX(*playerPosX, *playerPosY, rayDirX[i], rayDirY[i], &columnHits[first + i]);
+	}
+}
 
-	/* timing for input and FPS counter */
-	Uint32 end_time = SDL_GetTicks();
-    int frameTime = FPS_LIMIT;
+/* Draw the wall slices of one tile of cast columns, then the sprites in front of them */
+void DrawColumnTile(int tile, void *unused){
+	int end = (tile + 1) * COLUMNS_PER_TILE;
+	if (end > SCREEN_WIDTH) end = SCREEN_WIDTH;
+	for (int x = tile * COLUMNS_PER_TILE; x < end; x++) DrawColumn(x, &columnHits[x]);
+	if (visibleSpriteCount > 0) DrawSpriteColumns(tile * COLUMNS_PER_TILE, end);
+}
 
-    if((1000/FPS_LIMIT)>(end_time-start_time)){
-    	SDL_Delay((1000/FPS_LIMIT)-(end_time-start_time)); //Yay stable framerate!
-    }
+/* ---- CalibrateRayKernel() ---------------------------------------
+* Parameters: 	widest - widest kernel the CPU supports
+* Type: 		Public
+* Return:		the kernel to render with
+* Description:
+*	Casts the opening view a few times with every supported kernel
+*	and keeps the fastest. Wider packets are not always faster:
+*	it depends on the CPU's gather speed and the scene. The
+*	skipping kernel is tried too when the distance field is built;
+*	it wins on large open maps and loses in tight corridors.
+* --------------------------------- end CalibrateRayKernel() ---- */
+int CalibrateRayKernel(int widest){
+	Uint64 fastestTime = 0;
+	int fastest = KERNEL_SCALAR;
+
+	for (int kernel = KERNEL_SCALAR; kernel <= KERNEL_SKIP; kernel++){
+		if (kernel > widest && (kernel != KERNEL_SKIP || SelectRayKernel(KERNEL_SKIP) != KERNEL_SKIP)) continue;
+		rayKernel = kernel;
+		Uint64 elapsed = TimeOpeningView();
+		if (kernel == KERNEL_SCALAR || elapsed < fastestTime){
+			fastestTime = elapsed;
+			fastest = kernel;
+		}
+	}
+	return fastest;
+}
 
-    else{
-		frameTime = (end_time - start_time) / 1000.0; //frameTime is the time this frame has taken, in seconds
-    }
-	
+/* ---- CalibrateRayGrid() ---------------------------------------
+* Parameters: 	None
+* Type: 		Public
+* Return:		the grid to cast in
+* Description:
+*	Times the opening view with the chosen kernel in the byte
+*	cells and in the occupancy bits, and keeps the faster. The
+*	bits cost a few more instructions a step and only win once
+*	rays run far enough to leave the cache in the byte cells:
+*	large, open maps. The skipping kernel reads neither.
+* --------------------------------- end CalibrateRayGrid() ---- */
+int CalibrateRayGrid(){
+	if (rayKernel == KERNEL_SKIP) return GRID_CELLS;
+	rayGrid = GRID_CELLS;
+	Uint64 cellsTime = TimeOpeningView();
+	rayGrid = GRID_MORTON;
+	Uint64 mortonTime = TimeOpeningView();
+	return mortonTime < cellsTime ? GRID_MORTON : GRID_CELLS;
+}
 
+/* Time casting the opening view 8 times (after one untimed pass) with the current kernel and grid */
+Uint64 TimeOpeningView(){
+	double *rayDirX = malloc(sizeof(double) * SCREEN_WIDTH);
+	double *rayDirY = malloc(sizeof(double) * SCREEN_WIDTH);
+	ColumnHit *hits = malloc(sizeof(ColumnHit) * SCREEN_WIDTH);
 
-	if (displayFPS == FPS_WINDOW){
-		TTF_Font * font = TTF_OpenFont("opensans.ttf", 25);
-		SDL_Color color = { 255, 255, 255 };
+	for (int x = 0; x < SCREEN_WIDTH; x++){
+		double cameraX = 2 * x / ((double)(SCREEN_WIDTH) - 1);
+		rayDirX[x] = *playerDirX + *planeX * cameraX;
+		rayDirY[x] = *playerDirY + *planeY * cameraX;
+	}
+	CastRays(*playerPosX, *playerPosY, rayDirX, rayDirY, SCREEN_WIDTH, hits); // warm up
+	Uint64 start = SDL_GetPerformanceCounter();
+	for (int pass = 0; pass < 8; pass++){
+		CastRays(*playerPosX, *playerPosY, rayDirX, rayDirY, SCREEN_WIDTH, hits);
+	}
+	Uint64 elapsed = SDL_GetPerformanceCounter() - start;
 
-		char charFPS[5];
-		sprintf(charFPS, "%i", frameTime);
-		SDL_Surface * surface = TTF_RenderText_Solid(font, charFPS, color);
-		SDL_Texture * texture = SDL_CreateTextureFromSurface(renderer, surface);
+	free(rayDirX);
+	free(rayDirY);
+	free(hits);
+	return elapsed;
+}
 
-		int texW = 0;
-		int texH = 0;
-		SDL_QueryTexture(texture, NULL, NULL, &texW, &texH);
-		SDL_Rect dstrect = { 0, 0, texW, texH };
-		SDL_RenderCopy(renderer, texture, NULL, &dstrect);
-		
-		TTF_CloseFont(font);
-		SDL_DestroyTexture(texture);
-		SDL_FreeSurface(surface);
+/* ---- RunBench() ---------------------------------------
+* Parameters: 	None
+* Type: 		Public
+* Return:		None
+* Description:
+*	Renders -frames frames (default: the whole path once) from the
+*	camera path loaded by -bench, looping over it if needed, then
+*	reports the timings. Input is never read, so runs repeat.
+* --------------------------------- end RunBench() ---- */
+void RunBench(){
+	int frames = benchFrames > 0 ? benchFrames : benchPathLength;
+	benchTimings = malloc(sizeof(FrameTiming) * frames);
+
+	if (pipelineMode != PIPELINE_OFF) RunPipelined(frames);
+	for (int frame = 0; pipelineMode == PIPELINE_OFF && frame < frames; frame++){
+		ApplyCameraState(&benchPath[frame % benchPathLength], positionInfo);
+		if (editsPerFrame > 0) EditRandomCells(editsPerFrame, (int)*playerPosX, (int)*playerPosY);
+		RayCast();
+		benchTimings[frame] = frameTiming;
 	}
+	ReportBench(frames, WINDOW_WIDTH, WINDOW_HEIGHT, threadCount, rayKernelNames[rayKernel], rayGridNames[rayGrid], mapFile != NULL ? mapFile : "map1.h",
+		spriteCount, editsPerFrame);
 
+	free(benchTimings);
+	free(benchPath);
+}
 
-	if (displayFPS == FPS_TERMINAL){
-		printf("%i\n", frameTime);
+/* Screen rows a wall slice at the given distance covers; returns its unclipped height */
+HIDDEN int SliceBounds(double perpWallDist, int *drawStart, int *drawEnd){
+	return WallSliceRows(SCREEN_HEIGHT, perpWallDist, drawStart, drawEnd);
+}
+
+/* TRUE if the double ray turned either way by 1/32 of a column lands within a pixel of this slice */
+HIDDEN bool GrazesCorner(double rayDirX, double rayDirY, int drawStart, int drawEnd){
+	double turn = 2.0 / (SCREEN_WIDTH - 1) / 32;	// camera-plane units, like cameraX
+	ColumnHit turned;
+	for (int sign = -1; sign <= 1; sign += 2){
+		int start, end;
+		CastRayDouble(*playerPosX, *playerPosY, rayDirX + sign * turn * *planeX, rayDirY + sign * turn * *planeY, &turned);
+		SliceBounds(turned.perpWallDist, &start, &end);
+		if (abs(start - drawStart) <= 1 && abs(end - drawEnd) <= 1) return TRUE;
 	}
+	return FALSE;
+}
 
-	SDL_RenderPresent(renderer); // Display what we just made
+/* ---- CheckPrecision() ---------------------------------------
+* Parameters: 	None
+* Type: 		Public
+* Return:		TRUE if every column is within a pixel
+* Description:
+*	Casts every frame of the -bench camera path with the selected
+*	kernel and with CastRayDouble(), and compares where each
+*	column's wall slice starts and ends on screen. Meant for float
+*	and fixed point builds (make check-precision); a double build
+*	only confirms the kernels agree.
+*	A ray that passes a wall corner by less than the reduced
+*	precision can resolve may see through the gap in one build and
+*	not the other. Such columns are counted separately and do not
+*	fail the check, as long as turning the double ray by a small
+*	fraction of a pixel reproduces them.
+* --------------------------------- end CheckPrecision() ---- */
+int CheckPrecision(){
+	double *rayDirX = malloc(sizeof(double) * SCREEN_WIDTH);
+	double *rayDirY = malloc(sizeof(double) * SCREEN_WIDTH);
+	ColumnHit reference;
+	long offByOne = 0;
+	long grazing = 0;
+	long wrong = 0;
+
+	for (int frame = 0; frame < benchPathLength; frame++){
+		ApplyCameraState(&benchPath[frame], positionInfo);
+		for (int x = 0; x < SCREEN_WIDTH; x++){
+			double cameraX = 2 * x / ((double)(SCREEN_WIDTH) - 1);
+			rayDirX[x] = *playerDirX + *planeX * cameraX;
+			rayDirY[x] = *playerDirY + *planeY * cameraX;
+		}
+		CastRays(*playerPosX, *playerPosY, rayDirX, rayDirY, SCREEN_WIDTH, columnHits);
+		for (int x = 0; x < SCREEN_WIDTH; x++){
+			CastRayDouble(*playerPosX, *playerPosY, rayDirX[x], rayDirY[x], &reference);
+			int start, end, referenceStart, referenceEnd;
+			SliceBounds(columnHits[x].perpWallDist, &start, &end);
+			SliceBounds(reference.perpWallDist, &referenceStart, &referenceEnd);
+			int error = SDL_max(abs(start - referenceStart), abs(end - referenceEnd));
+			if (error == 1) offByOne++;
+			if (error > 1 && GrazesCorner(rayDirX[x], rayDirY[x], start, end)) grazing++;
+			else if (error > 1) wrong++;
+		}
+	}
+	printf("%s%s%s%i%s%i%s\n", "Precision check (", rayPrecisionNames[RAY_PRECISION], ", ", benchPathLength, " frames of ", SCREEN_WIDTH, " columns):");
+	printf("%s%li%s%li%s%li\n", "  columns off by one pixel ", offByOne, ", off by more at grazed corners ", grazing, ", off by more elsewhere ", wrong);
 
-	/* Every frame starts with a black background
-		It will be overwritten with actual data */
-    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
-    SDL_RenderClear(renderer);
+	free(rayDirX);
+	free(rayDirY);
+	free(benchPath);
+	return wrong == 0;
 }
 
+/* Draw the wall slice for one cast column */
+void DrawColumn(int x, const ColumnHit *hit){
+	// Calculate the beginning and end positions of the line
+	int drawStart, drawEnd;
+	int lineHeight = SliceBounds(hit->perpWallDist, &drawStart, &drawEnd);
+	// Textured walls: map values pick a texture, y-sides use its darkened copy
+	if (renderMode == RENDER_FRAMEBUFFER && textureAtlas != NULL){
+		int texture = (WORLD_CELL(hit->mapX, hit->mapY) - 1) % textureCount;
+		if (texture < 0) texture += textureCount;
+		TextureColumn(x, drawStart, drawEnd, lineHeight, TextureStrip(texture, hit->side, hit->texX));
+		return;
+	}
+	// Indexed: the shading table already knows the color for this cell, side and distance
+	if (renderMode == RENDER_INDEXED){
+		FillIndexedColumn(x, drawStart, drawEnd, shadeTable[WORLD_CELL(hit->mapX, hit->mapY)][hit->side][ShadeBand(hit->perpWallDist)]);
+		return;
+	}
+	// Choose wall color
+	double wall_color = WallColorNumber(WORLD_CELL(hit->mapX, hit->mapY));
+	// Give x and y sides different brightness
+	if (hit->side == 1) {wall_color = wall_color + 0.5;}
+	// Draw the vertical line associated with this array
+	if (renderMode == RENDER_FRAMEBUFFER) FillColumn(x, drawStart, drawEnd, WallColor(wall_color));
+	else verLine(x, drawStart, drawEnd, wall_color);
+}
+
+/* Poll for events and publish the keys held down; movement happens in StepPlayer() */
 void CheckForInput(){
-	/* Poll for events */
 	while( SDL_PollEvent( &event ) ){
 		/* SDL_QUIT event (window close by any means) */
 			// includes pressing X in tile bar, Alt+F4, Crtl+C in terminal, etc.
@@ -268,96 +790,52 @@ void CheckForInput(){
 			*readyToQuit = TRUE; // this variable is the end condition of the infinite loop,
 									// allowing the program to exit gracefully
 		}
-		else{
-			Uint8 *keystates = SDL_GetKeyboardState(NULL); // Get list of keys pressed
-		 	/* Search for certain key presses recorded in the keyboard event */
-
-
-			if( keystates[ SDL_SCANCODE_Q ] ){
-				*readyToQuit = TRUE;
-			}
-
-
-		 	/* Forward movement */
-			if( keystates[ SDL_SCANCODE_W ] ){
-			 	/* Determine coordinates of where we'd like to end up */
-			 		/* If we are holding left shift, we "sprint" by moving 2x speed */
-				double newXPos;
-				double newYPos;
-				if (keystates[ SDL_SCANCODE_LSHIFT]){
-					newXPos = *playerPosX + (*playerDirX * (*moveSpeed * 2));
-					newYPos = *playerPosY + (*playerDirY * (*moveSpeed * 2));
-				}
-
-				else{
-				 	newXPos = *playerPosX + (*playerDirX * *moveSpeed);
-				 	newYPos = *playerPosY + (*playerDirY * *moveSpeed);
-				}
-			 	/* End up there if we can */
-				if(worldMap[(int)(newXPos)][(int)(*playerPosY)] == EMPTYSPACE){
-					*playerPosX = newXPos;
-				}
-      			if(worldMap[(int)(*playerPosX)][(int)(newYPos)] == EMPTYSPACE){
-      				*playerPosY = newYPos;
-      			}
-			}
-
-			/* Backward movement */
-			if( keystates[ SDL_SCANCODE_S ] ){
-				/* Determine coordinates of where we'd like to end up */
-					/* If we are holding left shift, we "sprint" by moving 2x speed */
-				double newXPos;
-				double newYPos;
-				if (keystates[ SDL_SCANCODE_LSHIFT]){
-					newXPos = *playerPosX - (*playerDirX * (*moveSpeed * 2));
-					newYPos = *playerPosY - (*playerDirY * (*moveSpeed * 2));
-				}
-				else{
-					newXPos = *playerPosX - (*playerDirX * *moveSpeed);
-					newYPos = *playerPosY - (*playerDirY * *moveSpeed);
-				}
-			 	/* End up there if we can */
-				if(worldMap[(int)(newXPos)][(int)(*playerPosY)] == EMPTYSPACE){
-					*playerPosX = newXPos;
-				}
-      			if(worldMap[(int)(*playerPosX)][(int)(newYPos)] == EMPTYSPACE){
-      				*playerPosY = newYPos;
-      			}
-			}
-
-			/* Turn viewing direction to the left */
-			if( keystates[ 	SDL_SCANCODE_LEFT ]){
-			 	double oldDirX = *playerDirX;
-			 	*playerDirX = *playerDirX * cos(*rotSpeed) - *playerDirY * sin(*rotSpeed);
-			 	*playerDirY = oldDirX * sin(*rotSpeed) + *playerDirY * cos(*rotSpeed);
-			 	double oldPlaneX = *planeX;
-			 	*planeX = *planeX * cos(*rotSpeed) - *planeY * sin(*rotSpeed);
-			 	*planeY = oldPlaneX * sin(*rotSpeed) + *planeY * cos(*rotSpeed);
-			}
+	}
+	const Uint8 *keystates = SDL_GetKeyboardState(NULL); // Get list of keys pressed
+	if( keystates[ SDL_SCANCODE_Q ] ){
+		*readyToQuit = TRUE;
+	}
+	PublishHeldKeys((keystates[ SDL_SCANCODE_W ] ? KEY_FORWARD : 0)
+		| (keystates[ SDL_SCANCODE_S ] ? KEY_BACK : 0)
+		| (keystates[ SDL_SCANCODE_LEFT ] ? KEY_TURN_LEFT : 0)
+		| (keystates[ SDL_SCANCODE_RIGHT ] ? KEY_TURN_RIGHT : 0)
+		| (keystates[ SDL_SCANCODE_LSHIFT ] ? KEY_SPRINT : 0));
+}
 
-			/* Turn viewing direction to the right */
-			if( keystates[ 	SDL_SCANCODE_RIGHT ] ){
-			 	double oldDirX = *playerDirX;
-			 	*playerDirX = *playerDirX * cos(-*rotSpeed) - *playerDirY * sin(-*rotSpeed);
-			 	*playerDirY = oldDirX * sin(-*rotSpeed) + *playerDirY * cos(-*rotSpeed);
-			 	double oldPlaneX = *planeX;
-			 	*planeX = *planeX * cos(-*rotSpeed) - *planeY * sin(-*rotSpeed);
-			 	*planeY = oldPlaneX * sin(-*rotSpeed) + *planeY * cos(-*rotSpeed);
-			}
+/* ---- StepPlayer() ---------------------------------------
+* Parameters: 	camera state, dt - seconds to simulate, keys - heldKeys bits
+* Type: 		Public
+* Return:		None
+* Description:
+*	Moves and turns the player according to the keys held down,
+*	at moveSpeed cells and rotSpeed radians per second. Runs on the
+*	player thread with a fixed dt, so speed doesn't depend on the
+*	frame rate or on how many events arrive; it only reads the map
+*	and the speeds, never the renderer's camera.
+* --------------------------------- end StepPlayer() ---- */
+void StepPlayer(CameraState *state, double dt, int keys){
+	/* If we are holding left shift, we "sprint" by moving 2x speed */
+	double distance = *moveSpeed * dt * ((keys & KEY_SPRINT) ? 2 : 1);
+
+	/* Forward movement */
+	if( keys & KEY_FORWARD ){
+		MovePlayer(state, state->posX + state->dirX * distance, state->posY + state->dirY * distance);
+	}
 
-			/* Strafe to the left */
-			if( keystates[ 	SDL_SCANCODE_D ] ){
-			 	//printf("Hey, you pressed D!\n");
-			 	/* TODO: Implement strafing */
+	/* Backward movement */
+	if( keys & KEY_BACK ){
+		MovePlayer(state, state->posX - state->dirX * distance, state->posY - state->dirY * distance);
+	}
 
-			}
+	/* Turn viewing direction to the left */
+	if( keys & KEY_TURN_LEFT ){
+		TurnPlayer(state, *rotSpeed * dt);
+	}
 
-			/* Strafe to the right */
-			if( keystates[ SDL_SCANCODE_A ] ){
-				//printf("Hey, you pressed A!\n");
-				/* TODO: Implement strafing */
-			}
-		}
+	/* Turn viewing direction to the right */
+	if( keys & KEY_TURN_RIGHT ){
+		TurnPlayer(state, -*rotSpeed * dt);
 	}
-	
+
+	/* Strafing (A/D) is not implemented yet */
 }
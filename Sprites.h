@@ -0,0 +1,387 @@
+/**************************************************************
+* FILENAME:		Sprites.h
+*
+* DESCRIPTION:	Billboard sprites (props, pickups, enemies) drawn
+*				over the walls of the framebuffer renderers.
+*
+* NOTES:		Sprites are kept as a structure of arrays (position,
+*				type) sorted by bucket: SPRITE_BUCKET_CELLS x
+*				SPRITE_BUCKET_CELLS map cells, so a bucket's sprites
+*				are contiguous and a frame only looks at the buckets
+*				the view frustum reaches, however many sprites the map
+*				holds. The frustum ends at the farthest wall any
+*				column hit, since nothing behind that can show.
+*				Sprites that survive are sorted far to near and drawn
+*				column by column with the walls' tiles, each column
+*				clipped against the distance its wall was hit at
+*				(columnHits is the depth buffer). A sprite stands one
+*				cell high and wide on the floor; texels with zero
+*				alpha are see-through. Indexed frames draw sprites as
+*				silhouettes in their type's color, shaded with
+*				distance. The draw-call renderer has no sprites.
+*				Adding or moving a sprite marks the buckets for a
+*				rebuild (a counting sort) before the next frame; do it
+*				between frames, on the thread that renders.
+*				-sprites N scatters N sprites over the empty cells of
+*				the map.
+**************************************************************/
+
+#define SPRITE_TYPES		4		// barrel, pillar, tree, orb
+#define SPRITE_BUCKET_BITS	3
+#define SPRITE_BUCKET_CELLS	(1 << SPRITE_BUCKET_BITS)
+#define SPRITE_NEAR			0.2		// sprites closer than this (in front of the camera) are not drawn
+#define SPRITE_SHADES		7		// distance shades of a sprite color in indexed mode
+#define SPRITE_PALETTE		(FLOOR_PALETTE + FLOOR_TILES * SHADE_BANDS)	// first palette index after the floors'
+#define SPRITE_SEED			7
+
+// A sprite that made it into this frame
+typedef struct {
+	double depth;		// distance along the view direction, like perpWallDist
+	int slot;			// index into the sprite arrays
+	int left;			// first screen column, may be off screen
+	int top;			// first screen row, may be off screen
+	int width;			// size on screen in pixels: one cell across and one high,
+	int height;			// the same as a wall face at that depth
+} VisibleSprite;
+
+// Sprite globals
+int spriteRequest = 0;				// -sprites N
+int spriteCount = 0;
+int spriteCapacity = 0;
+double *spriteX = NULL;				// sprite arrays, in bucket order
+double *spriteY = NULL;
+Uint8 *spriteType = NULL;
+int *spriteId = NULL;				// id of the sprite in each slot
+int *spriteSlot = NULL;				// slot of each id
+int *bucketStart = NULL;			// first slot of every bucket, and one past the last
+int bucketsX = 0;
+int bucketsY = 0;
+bool bucketsDirty = FALSE;
+unsigned int spriteRevision = 0;	// changes whenever a sprite does
+unsigned int drawnSpriteRevision = 0;	// revision the last drawn frame showed
+Uint32 spriteTextures[SPRITE_TYPES][TEXTURE_TEXELS];	// [type][texX][texY], column-major like the wall atlas
+const Uint32 spriteColors[SPRITE_TYPES] = {0x8A5A2A, 0x9A9A9A, 0x2E8B3A, 0x40D0F0};
+VisibleSprite *visibleSprites = NULL;
+int visibleSpriteCount = 0;
+const ColumnHit *spriteDepth = NULL;	// column hits the visible sprites are clipped against
+long spriteFrames = 0;
+long spritesVisited = 0;			// sprites in the buckets the frustum reached
+long spritesDrawn = 0;
+
+/* Bucket of the cell a point lies in */
+static inline int SpriteBucket(double x, double y){
+	return ((int)x >> SPRITE_BUCKET_BITS) * bucketsY + ((int)y >> SPRITE_BUCKET_BITS);
+}
+
+/* One texel of a generated sprite, see-through outside its shape */
+HIDDEN Uint32 SpriteTexel(int type, int x, int y){
+	double dx = x - 31.5;
+	switch (type){
+	case 0: // barrel: bottom third of the cell, dark hoops
+		if (y < 36 || fabs(dx) > 12 - (y - 50) * (y - 50) / 64.0) return 0;
+		return COLOR_BLACK | ((y - 40) % 10 == 0 ? 0x3A2A1A : spriteColors[0] + (Uint32)(x % 6) * 0x030201);
+	case 1: // fluted pillar with a base and capital
+		if (fabs(dx) > ((y < 6 || y > 57) ? 12 : 8)) return 0;
+		return COLOR_BLACK | ((x % 4 == 0 && y >= 6 && y <= 57) ? 0x6A6A6A : spriteColors[1]);
+	case 2: // tree: round crown on a trunk
+		if (dx * dx + (y - 24) * (y - 24) < 20 * 20) return COLOR_BLACK | (((x * 5 + y * 3) % 7 < 2) ? 0x1E5A26 : spriteColors[2]);
+		if (fabs(dx) < 3 && y >= 24) return COLOR_BLACK | 0x5A3A1A;
+		return 0;
+	default: // orb pickup with a highlight
+		if (dx * dx + (y - 54) * (y - 54) >= 8 * 8) return 0;
+		return COLOR_BLACK | ((dx + 3) * (dx + 3) + (y - 51) * (y - 51) < 6 ? 0xFFFFFF : spriteColors[3]);
+	}
+}
+
+/* ---- CreateSprites() ---------------------------------------
+* Parameters: 	capacity - most sprites the map will hold
+* Type: 		Public
+* Return:		TRUE on success
+* Description:
+*	Allocates the sprite arrays and the buckets for the loaded map
+*	and generates the sprite textures and, in indexed mode, their
+*	palette entries.
+* --------------------------------- end CreateSprites() ---- */
+bool CreateSprites(int capacity){
+	bucketsX = (world.sizeX + SPRITE_BUCKET_CELLS - 1) >> SPRITE_BUCKET_BITS;
+	bucketsY = (world.sizeY + SPRITE_BUCKET_CELLS - 1) >> SPRITE_BUCKET_BITS;
+	spriteX = malloc(sizeof(double) * capacity * 2);	// each array has room for the rebuild to sort into
+	spriteY = malloc(sizeof(double) * capacity * 2);
+	spriteType = malloc(capacity * 2);
+	spriteId = malloc(sizeof(int) * capacity * 2);
+	spriteSlot = malloc(sizeof(int) * capacity);
+	bucketStart = calloc((size_t)bucketsX * bucketsY + 1, sizeof(int));
+	visibleSprites = malloc(sizeof(VisibleSprite) * capacity);
+	if (spriteX == NULL || spriteY == NULL || spriteType == NULL || spriteId == NULL || spriteSlot == NULL
+		|| bucketStart == NULL || visibleSprites == NULL) return FALSE;
+	spriteCapacity = capacity;
+	spriteCount = 0;
+
+	for (int type = 0; type < SPRITE_TYPES; type++){
+		for (int x = 0; x < TEXTURE_SIZE; x++){
+			for (int y = 0; y < TEXTURE_SIZE; y++) spriteTextures[type][x * TEXTURE_SIZE + y] = SpriteTexel(type, x, y);
+		}
+		for (int shade = 0; shade < SPRITE_SHADES && indexBuffer != NULL; shade++){
+			palette[SPRITE_PALETTE + type * SPRITE_SHADES + shade] = ShadeColor(spriteColors[type], shade * (SHADE_BANDS - 1) / (SPRITE_SHADES - 1));
+		}
+	}
+	return TRUE;
+}
+
+void DestroySprites(){
+	free(spriteX);
+	free(spriteY);
+	free(spriteType);
+	free(spriteId);
+	free(spriteSlot);
+	free(bucketStart);
+	free(visibleSprites);
+	spriteX = spriteY = NULL;
+	spriteType = NULL;
+	spriteId = spriteSlot = bucketStart = NULL;
+	visibleSprites = NULL;
+	spriteCount = spriteCapacity = visibleSpriteCount = 0;
+}
+
+/* Add a sprite standing at (x, y); returns its id, or -1 if the map is full or the point is off it */
+int AddSprite(double x, double y, int type){
+	if (spriteCount == spriteCapacity || x < 0 || y < 0 || x >= world.sizeX || y >= world.sizeY) return -1;
+	int id = spriteCount++;
+	spriteX[id] = x;
+	spriteY[id] = y;
+	spriteType[id] = (Uint8)(type % SPRITE_TYPES);
+	spriteId[id] = id;
+	spriteSlot[id] = id;
+	bucketsDirty = TRUE;
+	spriteRevision++;
+	return id;
+}
+
+/* Move a sprite; the buckets are only rebuilt if it left its own */
+void MoveSprite(int id, double x, double y){
+	int slot = spriteSlot[id];
+	if (x < 0 || y < 0 || x >= world.sizeX || y >= world.sizeY) return;
+	if (SpriteBucket(x, y) != SpriteBucket(spriteX[slot], spriteY[slot])) bucketsDirty = TRUE;
+	spriteX[slot] = x;
+	spriteY[slot] = y;
+	spriteRevision++;
+}
+
+/* ---- RebuildBuckets() ---------------------------------------
+* Parameters: 	None
+* Type: 		Public
+* Return:		None
+* Description:
+*	Counting sort of the sprites by bucket into the spare half of
+*	each array, copied back over the live half. Ids keep their
+*	sprites; only their slots move.
+* --------------------------------- end RebuildBuckets() ---- */
+void RebuildBuckets(){
+	int buckets = bucketsX * bucketsY;
+	int *next = bucketStart;
+	double *sortedX = spriteX + spriteCapacity;
+	double *sortedY = spriteY + spriteCapacity;
+	Uint8 *sortedType = spriteType + spriteCapacity;
+	int *sortedId = spriteId + spriteCapacity;
+
+	memset(bucketStart, 0, sizeof(int) * (buckets + 1));
+	for (int i = 0; i < spriteCount; i++) bucketStart[SpriteBucket(spriteX[i], spriteY[i]) + 1]++;
+	for (int b = 0; b < buckets; b++) bucketStart[b + 1] += bucketStart[b];
+	for (int i = 0; i < spriteCount; i++){
+		int slot = next[SpriteBucket(spriteX[i], spriteY[i])]++; // counts up to the next bucket's start
+		sortedX[slot] = spriteX[i];
+		sortedY[slot] = spriteY[i];
+		sortedType[slot] = spriteType[i];
+		sortedId[slot] = spriteId[i];
+	}
+	// next[] ran every bucket up to its end; shift back so bucketStart[b] is b's first slot
+	memmove(bucketStart + 1, bucketStart, sizeof(int) * buckets);
+	bucketStart[0] = 0;
+	memcpy(spriteX, sortedX, sizeof(double) * spriteCount);
+	memcpy(spriteY, sortedY, sizeof(double) * spriteCount);
+	memcpy(spriteType, sortedType, spriteCount);
+	memcpy(spriteId, sortedId, sizeof(int) * spriteCount);
+	for (int slot = 0; slot < spriteCount; slot++) spriteSlot[spriteId[slot]] = slot;
+	bucketsDirty = FALSE;
+}
+
+/* Scatter count sprites of random types over empty cells, the same way for the same map every run */
+int ScatterSprites(int count){
+	uint32_t state = SPRITE_SEED * 2654435761u + 1;
+	int tries = 0;
+	while (spriteCount < count && tries++ < count * 64){
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		int x = 1 + (int)(state % (uint32_t)(world.sizeX - 2));
+		int y = 1 + (int)((state >> 12) % (uint32_t)(world.sizeY - 2));
+		if (WORLD_CELL(x, y) != EMPTYSPACE) continue;
+		AddSprite(x + 0.5, y + 0.5, (int)(state >> 28));
+	}
+	return spriteCount;
+}
+
+/* Camera-space coordinates of a point: across the view in plane units, and depth along dir */
+static inline void SpriteView(const CameraState *camera, double invDet, double x, double y, double *across, double *depth){
+	double relX = x - camera->posX;
+	double relY = y - camera->posY;
+	*across = invDet * (camera->dirY * relX - camera->dirX * relY);
+	*depth = invDet * (camera->planeX * relY - camera->planeY * relX);
+}
+
+/* TRUE if a bucket, grown by half a cell for the sprites' width, can reach into the frustum */
+HIDDEN bool BucketInView(const CameraState *camera, double invDet, double maxDepth, int bx, int by){
+	double x0 = (bx << SPRITE_BUCKET_BITS) - 0.5;
+	double y0 = (by << SPRITE_BUCKET_BITS) - 0.5;
+	double x1 = x0 + SPRITE_BUCKET_CELLS + 1;
+	double y1 = y0 + SPRITE_BUCKET_CELLS + 1;
+	int left = 0, right = 0, near = 0, far = 0;
+
+	for (int corner = 0; corner < 4; corner++){
+		double across, depth;
+		SpriteView(camera, invDet, corner & 1 ? x1 : x0, corner & 2 ? y1 : y0, &across, &depth);
+		// The view spans across / depth from 0 to 2 (cameraX)
+		if (across < 0) left++;
+		if (across > 2 * depth) right++;
+		if (depth <= SPRITE_NEAR) near++;
+		if (depth >= maxDepth) far++;
+	}
+	return left < 4 && right < 4 && near < 4 && far < 4;
+}
+
+/* Far to near */
+HIDDEN int CompareSpriteDepth(const void *a, const void *b){
+	double depthA = ((const VisibleSprite *)a)->depth;
+	double depthB = ((const VisibleSprite *)b)->depth;
+	return (depthA < depthB) - (depthA > depthB);
+}
+
+/* ---- PrepareSprites() ---------------------------------------
+* Parameters: 	camera of the frame, its column hits
+* Type: 		Public
+* Return:		number of sprites to draw
+* Description:
+*	Called once per frame, after casting and before the columns
+*	are drawn. Visits the buckets under the frustum's bounding box
+*	that reach into it, projects their sprites the way columns are
+*	cast (a point at depth d and across a shows at cameraX a / d),
+*	drops those off screen or behind every wall they cover and
+*	sorts the rest far to near.
+* --------------------------------- end PrepareSprites() ---- */
+int PrepareSprites(const CameraState *camera, const ColumnHit *hits){
+	double maxDepth = 0;
+	double invDet = 1.0 / (camera->planeX * camera->dirY - camera->dirX * camera->planeY);
+	double columnScale = ((double)(SCREEN_WIDTH) - 1) / 2;
+	double planeLength = sqrt(camera->planeX * camera->planeX + camera->planeY * camera->planeY);
+
+	if (bucketsDirty) RebuildBuckets();
+	visibleSpriteCount = 0;
+	spriteDepth = hits;
+	drawnSpriteRevision = spriteRevision;
+	for (int x = 0; x < SCREEN_WIDTH; x++){
+		if (hits[x].perpWallDist > maxDepth) maxDepth = hits[x].perpWallDist;
+	}
+
+	// Bounding box of the frustum: the camera and the ends of its two edge rays at the farthest wall
+	double minX = camera->posX, maxX = camera->posX;
+	double minY = camera->posY, maxY = camera->posY;
+	for (int edge = 0; edge <= 2; edge += 2){
+		double endX = camera->posX + maxDepth * (camera->dirX + edge * camera->planeX);
+		double endY = camera->posY + maxDepth * (camera->dirY + edge * camera->planeY);
+		if (endX < minX) minX = endX;
+		if (endX > maxX) maxX = endX;
+		if (endY < minY) minY = endY;
+		if (endY > maxY) maxY = endY;
+	}
+	int firstX = SDL_max((int)(minX - 1) >> SPRITE_BUCKET_BITS, 0);
+	int lastX = SDL_min((int)(maxX + 1) >> SPRITE_BUCKET_BITS, bucketsX - 1);
+	int firstY = SDL_max((int)(minY - 1) >> SPRITE_BUCKET_BITS, 0);
+	int lastY = SDL_min((int)(maxY + 1) >> SPRITE_BUCKET_BITS, bucketsY - 1);
+
+	for (int bx = firstX; bx <= lastX; bx++){
+		for (int by = firstY; by <= lastY; by++){
+			int bucket = bx * bucketsY + by;
+			if (bucketStart[bucket] == bucketStart[bucket + 1] || !BucketInView(camera, invDet, maxDepth, bx, by)) continue;
+			spritesVisited += bucketStart[bucket + 1] - bucketStart[bucket];
+			for (int slot = bucketStart[bucket]; slot < bucketStart[bucket + 1]; slot++){
+				double across, depth;
+				SpriteView(camera, invDet, spriteX[slot], spriteY[slot], &across, &depth);
+				if (depth < SPRITE_NEAR || depth >= maxDepth) continue;
+				int height = (int)(SCREEN_HEIGHT / depth);
+				int width = (int)(columnScale / (planeLength * depth));
+				int left = (int)(across / depth * columnScale) - width / 2;
+				int first = SDL_max(left, 0);
+				int end = SDL_min(left + width, SCREEN_WIDTH);
+				if (height < 1 || first >= end) continue;
+				// Hidden if every column it covers has its wall in front of it
+				int x = first;
+				while (x < end && hits[x].perpWallDist <= depth) x++;
+				if (x == end) continue;
+
+				VisibleSprite *sprite = &visibleSprites[visibleSpriteCount++];
+				sprite->depth = depth;
+				sprite->slot = slot;
+				sprite->left = left;
+				sprite->top = SCREEN_HEIGHT / 2 - height / 2;	// where a wall slice at this depth starts
+				sprite->width = width;
+				sprite->height = height;
+			}
+		}
+	}
+	qsort(visibleSprites, visibleSpriteCount, sizeof(VisibleSprite), CompareSpriteDepth);
+	spriteFrames++;
+	spritesDrawn += visibleSpriteCount;
+	return visibleSpriteCount;
+}
+
+/* ---- DrawSpriteColumns() ---------------------------------------
+* Parameters: 	first and one past the last screen column
+* Type: 		Public
+* Return:		None
+* Description:
+*	Draws the visible sprites, far to near, into a run of columns
+*	whose walls are already drawn, so column tiles can run on any
+*	thread. A sprite column is skipped where its wall is nearer.
+* --------------------------------- end DrawSpriteColumns() ---- */
+void DrawSpriteColumns(int first, int end){
+	for (int i = 0; i < visibleSpriteCount; i++){
+		const VisibleSprite *sprite = &visibleSprites[i];
+		int x0 = SDL_max(sprite->left, first);
+		int x1 = SDL_min(sprite->left + sprite->width, end);
+		if (x0 >= x1) continue;
+		int type = spriteType[sprite->slot];
+		int y0 = SDL_max(sprite->top, 0);
+		int y1 = SDL_min(sprite->top + sprite->height, SCREEN_HEIGHT);
+		// 16.16 texels per screen column and row
+		Uint32 stepX = ((Uint32)TEXTURE_SIZE << 16) / (Uint32)sprite->width;
+		Uint32 stepY = ((Uint32)TEXTURE_SIZE << 16) / (Uint32)sprite->height;
+		Uint32 texStart = (Uint32)(y0 - sprite->top) * stepY;
+		Uint8 index = SPRITE_PALETTE + type * SPRITE_SHADES + ShadeBand(sprite->depth) * (SPRITE_SHADES - 1) / (SHADE_BANDS - 1);
+
+		for (int x = x0; x < x1; x++){
+			if (spriteDepth[x].perpWallDist <= sprite->depth) continue;
+			const Uint32 *strip = spriteTextures[type] + (((Uint32)(x - sprite->left) * stepX) >> 16) * TEXTURE_SIZE;
+			Uint32 texPos = texStart;
+			if (renderMode == RENDER_INDEXED){
+				Uint8 *pixel = indexBuffer + (size_t)y0 * SCREEN_WIDTH + x;
+				for (int y = y0; y < y1; y++, pixel += SCREEN_WIDTH, texPos += stepY){
+					if (strip[texPos >> 16] != 0) *pixel = index;
+				}
+			}
+			else{
+				Uint32 *pixel = frameBuffer + (size_t)y0 * SCREEN_WIDTH + x;
+				for (int y = y0; y < y1; y++, pixel += SCREEN_WIDTH, texPos += stepY){
+					Uint32 texel = strip[texPos >> 16];
+					if (texel != 0) *pixel = texel;
+				}
+			}
+		}
+	}
+}
+
+/* One line summary for the end of a run */
+void ReportSprites(FILE *out){
+	if (spriteCount == 0 || spriteFrames == 0) return;
+	fprintf(out, "%s%i%s%.1f%s%.1f%s\n", "Sprites: ", spriteCount, " on the map, ", (double)spritesVisited / spriteFrames,
+		" looked at and ", (double)spritesDrawn / spriteFrames, " drawn per frame");
+}
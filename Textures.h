@@ -0,0 +1,193 @@
+/**************************************************************
+* FILENAME:		Textures.h
+*
+* DESCRIPTION:	Wall textures for the framebuffer renderer.
+*
+* NOTES:		The atlas is TEXTURE_SIZE x TEXTURE_SIZE textures
+*				stored column-major: a screen column only ever samples
+*				one texture column, so it reads one contiguous strip
+*				instead of striding across rows. Every texture also
+*				has a pre-darkened copy for y-sides, so no shading
+*				happens per pixel.
+*				-textures file.bmp loads the atlas from a BMP with the
+*				textures side by side (TEXTURE_SIZE pixels high, a
+*				multiple of it wide); map value v uses texture
+*				(v - 1) modulo the count. Without it a built-in set is
+*				generated, and -textures off keeps the flat colors.
+*				The per-column draw call path is always flat.
+**************************************************************/
+
+#define TEXTURE_SIZE		64		// power of two, texture coordinates wrap with a mask
+#define TEXTURE_TEXELS		(TEXTURE_SIZE * TEXTURE_SIZE)
+#define TEXTURE_SHADES		2		// lit (x-side) and darkened (y-side) copies
+#define GENERATED_TEXTURES	5
+
+// Texture globals
+char *textureFile = NULL;		// -textures file.bmp, NULL = generated set
+bool texturesEnabled = TRUE;	// -textures off
+Uint32 *textureAtlas = NULL;	// [texture][shade][texX][texY], ARGB8888
+int textureCount = 0;
+
+/* Same darkening as WallColor() gives y-sides: every channel roughly halved */
+HIDDEN Uint32 DarkenTexel(Uint32 color){
+	return ((color >> 1) & 0x007F7F7F) | COLOR_BLACK;
+}
+
+/* Contiguous strip of TEXTURE_SIZE texels for one column of a texture */
+static inline const Uint32 *TextureStrip(int texture, int side, int texX){
+	return textureAtlas + ((size_t)(texture * TEXTURE_SHADES + side) * TEXTURE_SIZE + texX) * TEXTURE_SIZE;
+}
+
+/* Allocate the atlas for count textures */
+HIDDEN bool AllocateTextures(int count){
+	textureAtlas = malloc(sizeof(Uint32) * TEXTURE_TEXELS * TEXTURE_SHADES * count);
+	textureCount = textureAtlas != NULL ? count : 0;
+	return textureAtlas != NULL;
+}
+
+/* Store one texel (given in row/column terms) in both shades */
+HIDDEN void SetTexel(int texture, int texX, int texY, Uint32 color){
+	Uint32 *lit = textureAtlas + (size_t)texture * TEXTURE_SHADES * TEXTURE_TEXELS;
+	lit[texX * TEXTURE_SIZE + texY] = color | COLOR_BLACK;
+	lit[TEXTURE_TEXELS + texX * TEXTURE_SIZE + texY] = DarkenTexel(color);
+}
+
+/* ---- GenerateTextures() ---------------------------------------
+* Parameters: 	None
+* Type: 		Public
+* Return:		TRUE on success
+* Description:
+*	Built-in textures, one per flat wall color so maps keep their
+*	look: red brick, green xor pattern, blue stone blocks, white
+*	tiles and yellow planks.
+* --------------------------------- end GenerateTextures() ---- */
+bool GenerateTextures(){
+	if (!AllocateTextures(GENERATED_TEXTURES)) return FALSE;
+	for (int x = 0; x < TEXTURE_SIZE; x++){
+		for (int y = 0; y < TEXTURE_SIZE; y++){
+			int xor = (x * 256 / TEXTURE_SIZE) ^ (y * 256 / TEXTURE_SIZE);
+			// Bricks: 16 rows high, every other row shifted by half a brick
+			int brickX = (x + (y / 16 % 2) * 16) % 32;
+			bool mortar = y % 16 == 0 || brickX == 0;
+			// Stone blocks with a slight top-to-bottom gradient
+			bool seam = x % 32 == 0 || y % 32 == 0;
+			int shade = 160 + ((y % 32) * 3);
+			// Planks: vertical boards with a wavy grain
+			int grain = 170 + (int)(30 * sin((y + 7 * (x / 16)) * 0.4 + x * 0.9));
+
+			SetTexel(0, x, y, mortar ? 0xB4B4B4 : (0xC00000 + ((xor & 0x1F) << 16)));
+			SetTexel(1, x, y, (Uint32)(xor / 2 + 64) << 8);
+			SetTexel(2, x, y, seam ? 0x101040 : (Uint32)(shade / 3) << 8 | (Uint32)shade);
+			SetTexel(3, x, y, (x / 8 + y / 8) % 2 ? 0xF0F0F0 : 0xC8C8C8);
+			SetTexel(4, x, y, x % 16 == 0 ? 0x604000 : (Uint32)grain << 16 | (Uint32)(grain * 3 / 4) << 8);
+		}
+	}
+	return TRUE;
+}
+
+/* ---- LoadTextureAtlas() ---------------------------------------
+* Parameters: 	path of a BMP atlas
+* Type: 		Public
+* Return:		TRUE on success
+* Description:
+*	Loads textures laid out side by side and transposes each one
+*	into the column-major atlas.
+* --------------------------------- end LoadTextureAtlas() ---- */
+bool LoadTextureAtlas(const char *path){
+	SDL_Surface *loaded = SDL_LoadBMP(path);
+	if (loaded == NULL){
+		printf("%s%s%s%s\n", "Could not load textures ", path, ": ", SDL_GetError());
+		return FALSE;
+	}
+	SDL_Surface *surface = SDL_ConvertSurfaceFormat(loaded, SDL_PIXELFORMAT_ARGB8888, 0);
+	SDL_FreeSurface(loaded);
+	if (surface == NULL || surface->h != TEXTURE_SIZE || surface->w < TEXTURE_SIZE || surface->w % TEXTURE_SIZE != 0){
+		printf("%s%s%s%i%s\n", "Texture atlas ", path, " must be ", TEXTURE_SIZE, " pixels high and a multiple of that wide");
+		if (surface != NULL) SDL_FreeSurface(surface);
+		return FALSE;
+	}
+	if (!AllocateTextures(surface->w / TEXTURE_SIZE)){
+		SDL_FreeSurface(surface);
+		return FALSE;
+	}
+	SDL_LockSurface(surface);
+	for (int y = 0; y < TEXTURE_SIZE; y++){
+		const Uint32 *row = (const Uint32 *)((const Uint8 *)surface->pixels + y * surface->pitch);
+		for (int x = 0; x < surface->w; x++){
+			SetTexel(x / TEXTURE_SIZE, x % TEXTURE_SIZE, y, row[x]);
+		}
+	}
+	SDL_UnlockSurface(surface);
+	SDL_FreeSurface(surface);
+	return TRUE;
+}
+
+void FreeTextures(){
+	free(textureAtlas);
+	textureAtlas = NULL;
+	textureCount = 0;
+}
+
+/* Texture column a ray hits: where along the wall it landed, mirrored so textures never appear flipped */
+int TextureX(double posX, double posY, double rayDirX, double rayDirY, const ColumnHit *hit){
+	double wallX = hit->side == 0 ? posY + hit->perpWallDist * rayDirY : posX + hit->perpWallDist * rayDirX;
+	int texX = (int)((wallX - floor(wallX)) * TEXTURE_SIZE);
+	if (hit->side == 0 && rayDirX > 0) texX = TEXTURE_SIZE - texX - 1;
+	if (hit->side == 1 && rayDirY < 0) texX = TEXTURE_SIZE - texX - 1;
+	return texX & (TEXTURE_SIZE - 1);
+}
+
+/* ---- SampleStrip() ---------------------------------------
+* Parameters: 	output texels, count, texture strip, 16.16 start and step
+* Type: 		Public
+* Return:		None
+* Description:
+*	Scales a texture strip to a wall slice. Texel i is computed
+*	straight from i (no running sum) into a contiguous buffer, so
+*	the loop vectorizes; the optimize attribute asks for that even
+*	at -O2, where GCC would otherwise only vectorize trivially cheap
+*	loops.
+* --------------------------------- end SampleStrip() ---- */
+__attribute__((optimize("tree-vectorize", "vect-cost-model=dynamic")))
+void SampleStrip(Uint32 *restrict texels, int count, const Uint32 *restrict strip, Uint32 texPos, Uint32 step){
+	for (int i = 0; i < count; i++){
+		texels[i] = strip[((texPos + (Uint32)i * step) >> 16) & (TEXTURE_SIZE - 1)];
+	}
+}
+
+/* ---- TextureStripColumn() ---------------------------------------
+* Parameters: 	top pixel of a column, pitch between its pixels,
+*				its height, visible slice, full slice height,
+*				texture strip, clear - black above and below
+* Type: 		Public
+* Return:		None
+* Description:
+*	FillStrip() for a textured wall slice: the strip scaled to
+*	lineHeight between drawStart and drawEnd. Where the slice is
+*	taller than the column, sampling starts part way down the
+*	texture.
+* --------------------------------- end TextureStripColumn() ---- */
+void TextureStripColumn(Uint32 *pixel, int pitch, int height, int drawStart, int drawEnd, int lineHeight, const Uint32 *strip, bool clear){
+	int count = drawEnd - drawStart + 1;
+	Uint32 texels[count];
+	int y = 0;
+
+	if (lineHeight < 1) lineHeight = 1;
+	// 16.16 texture rows per screen row, and where the visible part starts
+	Uint32 step = ((Uint32)TEXTURE_SIZE << 16) / (Uint32)lineHeight;
+	Uint32 texPos = (Uint32)(drawStart - height / 2 + lineHeight / 2) * step;
+	SampleStrip(texels, count, strip, texPos, step);
+
+	if (!clear){
+		y = drawStart;
+		pixel += (size_t)drawStart * pitch;
+	}
+	for (; y < drawStart; y++, pixel += pitch) *pixel = COLOR_BLACK;
+	for (int i = 0; i < count; i++, y++, pixel += pitch) *pixel = texels[i];
+	for (; clear && y < height; y++, pixel += pitch) *pixel = COLOR_BLACK;
+}
+
+/* FillColumn() for a textured wall slice: black above and below it unless floors are drawn */
+void TextureColumn(int x, int drawStart, int drawEnd, int lineHeight, const Uint32 *strip){
+	TextureStripColumn(frameBuffer + x, SCREEN_WIDTH, SCREEN_HEIGHT, drawStart, drawEnd, lineHeight, strip, clearAroundWalls);
+}
@@ -0,0 +1,267 @@
+/**************************************************************
+* FILENAME:		ViewCache.h
+*
+* DESCRIPTION:	Reuses the last frame's ray hits when the camera
+*				has not moved.
+*
+* NOTES:		Every frame's camera is compared with the one the
+*				current column hits were cast from (and the map's
+*				revision and the resolution with the ones they saw):
+*				- identical: nothing is cast, and if the frame it
+*				  would draw into still holds that frame, nothing is
+*				  drawn either; an idle main loop then sleeps until
+*				  the next event instead of spinning;
+*				- same position, different direction (turning in
+*				  place): a new ray that lies between two old rays
+*				  that hit the same face of the same wall cell must
+*				  hit that face too, since the cells in front of it
+*				  were empty for both. Such columns take the old hit
+*				  with the distance worked out for the new ray, the
+*				  same way every double kernel does; only the rest
+*				  are cast;
+*				- same camera, and the map changed by one batch of
+*				  edits since (MapEdit.h): a ray whose path up to its
+*				  hit stays clear of the box around the edited cells
+*				  hits the same wall as before, so only rays that
+*				  cross the box are cast again;
+*				- anything else casts every column.
+*				Reused hits report 0 steps. Rotation reuse needs the
+*				double kernels' distance formula, so float and fixed
+*				point builds only use the identical-camera case.
+*				-viewcache off disables it.
+**************************************************************/
+
+#define VIEW_MOVED			0
+#define VIEW_TURNED			1
+#define VIEW_UNCHANGED		2
+#define VIEW_EDITED			3
+#define IDLE_WAIT_MS		250		// longest an idle main loop sleeps before checking again
+#define EDIT_MARGIN			0.0625	// cells a ray must pass clear of an edited cell to keep its hit
+
+// View cache globals
+bool viewCacheEnabled = TRUE;		// -viewcache off
+bool viewCacheValid = FALSE;		// the column hits belong to cachedCamera
+CameraState cachedCamera;
+unsigned int cachedRevision;
+int cachedWidth;					// resolution the hits and pixels were rendered at
+int cachedHeight;
+const Uint32 *cachedPixels = NULL;	// buffer that holds the frame drawn from those hits, NULL if none
+ColumnHit *previousHits = NULL;		// hits of the last frame while a turned frame is being cast
+CameraState previousCamera;			// and the camera they were cast from
+int viewState = VIEW_MOVED;			// how the frame being rendered relates to the cache
+long cachedFrames = 0;				// frames rendered
+long unchangedFrames = 0;
+long cachedColumns = 0;				// columns rendered
+long reusedColumns = 0;
+volatile bool waitingForInput = FALSE;	// the main loop is asleep in WaitForInput()
+
+bool CreateViewCache(){
+	previousHits = malloc(sizeof(ColumnHit) * WINDOW_WIDTH);
+	return previousHits != NULL;
+}
+
+void DestroyViewCache(){
+	free(previousHits);
+	previousHits = NULL;
+}
+
+/* Ray direction of screen column x for a camera, exactly as CastColumnTile() computes it */
+static inline void ColumnRay(const CameraState *camera, int x, double *rayDirX, double *rayDirY){
+	double cameraX = ColumnCameraX(x);
+	*rayDirX = camera->dirX + camera->planeX * cameraX;
+	*rayDirY = camera->dirY + camera->planeY * cameraX;
+}
+
+/* ---- BeginViewFrame() ---------------------------------------
+* Parameters: 	camera of the frame about to be rendered, the
+*				frame's hit buffer
+* Type: 		Public
+* Return:		VIEW_MOVED, VIEW_TURNED, VIEW_UNCHANGED or VIEW_EDITED
+* Description:
+*	Classifies the frame against the cache. For a turned frame the
+*	last hits move to previousHits (the buffers swap), so the hit
+*	buffer can be filled in while they are read.
+* --------------------------------- end BeginViewFrame() ---- */
+int BeginViewFrame(const CameraState *camera, ColumnHit **hits){
+	viewState = VIEW_MOVED;
+	if (viewCacheEnabled && viewCacheValid && cachedWidth == SCREEN_WIDTH && cachedHeight == SCREEN_HEIGHT){
+		bool sameCamera = !memcmp(camera, &cachedCamera, sizeof(CameraState));
+		if (cachedRevision != world.revision){
+			if (sameCamera && cachedRevision == world.editBase && world.revision == world.editBase + 1) viewState = VIEW_EDITED;
+		}
+		else if (sameCamera) viewState = VIEW_UNCHANGED;
+		else if (RAY_PRECISION == RAY_DOUBLE && previousHits != NULL
+			&& camera->posX == cachedCamera.posX && camera->posY == cachedCamera.posY) viewState = VIEW_TURNED;
+	}
+	if (viewState == VIEW_TURNED){
+		ColumnHit *swap = previousHits;
+		previousHits = *hits;
+		*hits = swap;
+		previousCamera = cachedCamera;
+	}
+	if (viewState != VIEW_UNCHANGED){
+		cachedCamera = *camera;
+		cachedRevision = world.revision;
+		cachedWidth = SCREEN_WIDTH;
+		cachedHeight = SCREEN_HEIGHT;
+		cachedPixels = NULL;
+	}
+	viewCacheValid = TRUE;
+	cachedFrames++;
+	cachedColumns += SCREEN_WIDTH;
+	if (viewState == VIEW_UNCHANGED){
+		unchangedFrames++;
+		reusedColumns += SCREEN_WIDTH;
+	}
+	return viewState;
+}
+
+/* Where along its face a hit lies: y for x-sides, x for y-sides */
+static inline double FacePosition(const CameraState *camera, const ColumnHit *hit, double rayDirX, double rayDirY){
+	if (hit->side == 0) return camera->posY + hit->perpWallDist * rayDirY;
+	return camera->posX + hit->perpWallDist * rayDirX;
+}
+
+/* ---- ReuseTurnedColumns() ---------------------------------------
+* Parameters: 	new ray directions of count columns, their hits,
+*				flags to set for reused columns
+* Type: 		Public
+* Return:		number of columns reused
+* Description:
+*	For each new ray, solves for where it crosses the old camera
+*	plane to find the two adjacent old rays it lies between, and
+*	reuses their hit if both struck the same face less than a cell
+*	apart: a wall cell in front of the face but clear of both old
+*	rays would have to fit in the sliver between them. Rays outside
+*	the old field of view are left to be cast.
+* --------------------------------- end ReuseTurnedColumns() ---- */
+int ReuseTurnedColumns(const double *rayDirX, const double *rayDirY, int count, ColumnHit *hits, bool *reused){
+	const CameraState *old = &previousCamera;
+	double columnScale = ((double)(SCREEN_WIDTH) - 1) / 2;	// old columns per unit of camera space
+	int reusedCount = 0;
+
+	for (int i = 0; i < count; i++){
+		double leftX, leftY, rightX, rightY;
+		reused[i] = FALSE;
+
+		// Old ray at camera space c is dir + plane * c; it is parallel to the new ray where its cross product vanishes
+		double across = old->planeX * rayDirY[i] - old->planeY * rayDirX[i];
+		if (across == 0) continue;
+		double c = -(old->dirX * rayDirY[i] - old->dirY * rayDirX[i]) / across;
+		if (!(c >= 0 && c * columnScale < SCREEN_WIDTH - 1)) continue;
+		if ((old->dirX + old->planeX * c) * rayDirX[i] + (old->dirY + old->planeY * c) * rayDirY[i] <= 0) continue; // behind the camera
+		int left = (int)(c * columnScale);
+
+		// Check the bracket with the exact old rays, since c was rounded
+		ColumnRay(old, left, &leftX, &leftY);
+		ColumnRay(old, left + 1, &rightX, &rightY);
+		double leftSide = (leftX * rayDirY[i] - leftY * rayDirX[i]) * across;
+		double rightSide = (rightX * rayDirY[i] - rightY * rayDirX[i]) * across;
+		if (leftSide > 0 || rightSide < 0) continue;
+
+		const ColumnHit *a = &previousHits[left];
+		const ColumnHit *b = &previousHits[left + 1];
+		if (a->mapX != b->mapX || a->mapY != b->mapY || a->side != b->side) continue;
+		if (fabs(FacePosition(old, a, leftX, leftY) - FacePosition(old, b, rightX, rightY)) >= 1) continue;
+
+		ColumnHit *hit = &hits[i];
+		hit->mapX = a->mapX;
+		hit->mapY = a->mapY;
+		hit->side = a->side;
+		hit->steps = 0;
+		hit->perpWallDist = PerpWallDist(old->posX, old->posY, rayDirX[i], rayDirY[i], a->mapX, a->mapY, a->side);
+		reused[i] = TRUE;
+		reusedCount++;
+	}
+	return reusedCount;
+}
+
+/* TRUE if the segment from (posX, posY) along (dirX, dirY) for up to length touches the box */
+HIDDEN bool SegmentTouchesBox(double posX, double posY, double dirX, double dirY, double length,
+	double minX, double minY, double maxX, double maxY){
+	double enter = 0;
+	double leave = length;
+	if (dirX == 0){
+		if (posX < minX || posX > maxX) return FALSE;
+	}
+	else{
+		double near = (minX - posX) / dirX;
+		double far = (maxX - posX) / dirX;
+		if (near > far){ double swap = near; near = far; far = swap; }
+		if (near > enter) enter = near;
+		if (far < leave) leave = far;
+	}
+	if (dirY == 0){
+		if (posY < minY || posY > maxY) return FALSE;
+	}
+	else{
+		double near = (minY - posY) / dirY;
+		double far = (maxY - posY) / dirY;
+		if (near > far){ double swap = near; near = far; far = swap; }
+		if (near > enter) enter = near;
+		if (far < leave) leave = far;
+	}
+	return enter <= leave;
+}
+
+/* ---- ReuseUneditedColumns() ---------------------------------------
+* Parameters: 	ray directions of count columns, their hits (still
+*				the cached ones), flags to set for reused columns
+* Type: 		Public
+* Return:		number of columns reused
+* Description:
+*	For a frame whose camera is the cached one but whose map had
+*	one batch of edits applied since, keeps each hit whose ray,
+*	from the camera to the wall it hit, passes clear of the box
+*	around the edited cells: every cell it crossed is unchanged,
+*	and so is the one it hit. perpWallDist along a ray direction
+*	reaches the hit face, which is on the hit cell, so a ray that
+*	hit an edited cell always touches the box. EDIT_MARGIN covers
+*	rounding in the kernels' distances.
+* --------------------------------- end ReuseUneditedColumns() ---- */
+int ReuseUneditedColumns(const double *rayDirX, const double *rayDirY, int count, ColumnHit *hits, bool *reused){
+	double minX = world.editMinX - EDIT_MARGIN;
+	double minY = world.editMinY - EDIT_MARGIN;
+	double maxX = world.editMaxX + 1 + EDIT_MARGIN;
+	double maxY = world.editMaxY + 1 + EDIT_MARGIN;
+	int reusedCount = 0;
+
+	for (int i = 0; i < count; i++){
+		reused[i] = !SegmentTouchesBox(cachedCamera.posX, cachedCamera.posY, rayDirX[i], rayDirY[i],
+			hits[i].perpWallDist + EDIT_MARGIN, minX, minY, maxX, maxY);
+		if (!reused[i]) continue;
+		hits[i].steps = 0;
+		reusedCount++;
+	}
+	return reusedCount;
+}
+
+/* Count columns a tile reused; tiles finish on any worker thread */
+void CountReusedColumns(int reused){
+	__sync_fetch_and_add(&reusedColumns, reused);
+}
+
+/* Remember which buffer now holds the frame drawn from the cached hits */
+void EndViewFrame(const Uint32 *pixels){
+	cachedPixels = pixels;
+}
+
+/* Share of all columns rendered so far that were not cast */
+double ViewCacheHitRate(){
+	return cachedColumns > 0 ? (double)reusedColumns / cachedColumns : 0;
+}
+
+/* One line summary for the end of a run */
+void ReportViewCache(FILE *out){
+	if (!viewCacheEnabled || cachedFrames == 0) return;
+	fprintf(out, "%s%li%s%li%s%.1f%s\n", "View cache: ", unchangedFrames, " of ", cachedFrames, " frames unchanged, ",
+		100.0 * ViewCacheHitRate(), "% of columns reused");
+}
+
+/* Sleep until an event arrives (or IDLE_WAIT_MS passes) instead of presenting the same frame again; the event stays queued for CheckForInput() */
+void WaitForInput(){
+	waitingForInput = TRUE;	// map edits from other threads push an event to end the wait
+	SDL_WaitEventTimeout(NULL, IDLE_WAIT_MS);
+	waitingForInput = FALSE;
+	paceNext = 0; // the frame after a wait starts a new pacing schedule
+}
@@ -0,0 +1,121 @@
+/**************************************************************
+* FILENAME:		WorkerPool.h
+*
+* DESCRIPTION:	Persistent pthread worker pool used to split a frame
+*				into independent tiles (e.g. groups of screen columns).
+*
+* NOTES:		Threads are created once at startup and sleep between
+*				frames. ParallelFor() hands out tiles through a shared
+*				atomic counter, so fast threads pick up more tiles
+*				than slow ones, and returns only once every tile is
+*				done (the barrier before present).
+*				The calling thread works on tiles too, so a pool of
+*				N threads starts N-1 pthreads.
+*				Any thread may call ParallelFor(); while one call owns
+*				the pool, a call from another thread (gameplay queries
+*				during a pipelined frame) runs its tiles itself rather
+*				than waiting for the pool.
+**************************************************************/
+
+typedef void (*TileJob)(int tile, void *data);
+
+// Worker pool globals
+int threadCount = 0;				// 0 = use every core (see -threads)
+pthread_t *workerThreads = NULL;
+pthread_mutex_t poolMutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t poolWake = PTHREAD_COND_INITIALIZER;
+pthread_cond_t poolDone = PTHREAD_COND_INITIALIZER;
+pthread_mutex_t poolOwner = PTHREAD_MUTEX_INITIALIZER;	// held by the thread whose ParallelFor() is running
+unsigned int poolGeneration = 0;	// bumped once per ParallelFor() call
+int poolQuit = FALSE;
+TileJob poolJob;
+void *poolData;
+int poolTileCount;
+volatile int poolNextTile;			// next tile nobody has claimed yet
+volatile int poolBusy;				// threads that have not finished this generation
+
+/* Claim and run tiles until there are none left */
+HIDDEN void RunTiles(){
+	int tile;
+	while ((tile = __sync_fetch_and_add(&poolNextTile, 1)) < poolTileCount){
+		poolJob(tile, poolData);
+	}
+	if (__sync_sub_and_fetch(&poolBusy, 1) == 0){
+		pthread_mutex_lock(&poolMutex);
+		pthread_cond_signal(&poolDone);
+		pthread_mutex_unlock(&poolMutex);
+	}
+}
+
+HIDDEN void *WorkerMain(void *unused){
+	unsigned int seenGeneration = 0;
+	for (;;){
+		pthread_mutex_lock(&poolMutex);
+		while (seenGeneration == poolGeneration && !poolQuit){
+			pthread_cond_wait(&poolWake, &poolMutex);
+		}
+		if (poolQuit){
+			pthread_mutex_unlock(&poolMutex);
+			return NULL;
+		}
+		seenGeneration = poolGeneration;
+		pthread_mutex_unlock(&poolMutex);
+		RunTiles();
+	}
+}
+
+/* Start count-1 workers; count <= 0 means one thread per core */
+bool CreateWorkerPool(int count){
+	if (count <= 0) count = SDL_GetCPUCount();
+	if (count < 1) count = 1;
+	threadCount = count;
+	workerThreads = malloc(sizeof(pthread_t) * threadCount);
+	for (int i = 1; i < threadCount; i++){
+		if (pthread_create(&workerThreads[i], NULL, WorkerMain, NULL) != 0){
+			printf("%s%i%s\n", "Could only start ", i, " render threads");
+			threadCount = i;
+			break;
+		}
+	}
+	return threadCount > 1;
+}
+
+void DestroyWorkerPool(){
+	pthread_mutex_lock(&poolMutex);
+	poolQuit = TRUE;
+	pthread_cond_broadcast(&poolWake);
+	pthread_mutex_unlock(&poolMutex);
+	for (int i = 1; i < threadCount; i++){
+		pthread_join(workerThreads[i], NULL);
+	}
+	free(workerThreads);
+	workerThreads = NULL;
+	threadCount = 1;
+}
+
+/* Run job(tile, data) for every tile in [0, tileCount) across the pool and wait for all of them */
+void ParallelFor(int tileCount, TileJob job, void *data){
+	if (threadCount <= 1 || pthread_mutex_trylock(&poolOwner) != 0){
+		for (int tile = 0; tile < tileCount; tile++) job(tile, data);
+		return;
+	}
+
+	pthread_mutex_lock(&poolMutex);
+	poolJob = job;
+	poolData = data;
+	poolTileCount = tileCount;
+	poolNextTile = 0;
+	poolBusy = threadCount;
+	poolGeneration++;
+	pthread_cond_broadcast(&poolWake);
+	pthread_mutex_unlock(&poolMutex);
+
+	RunTiles();
+
+	pthread_mutex_lock(&poolMutex);
+	while (poolBusy > 0){
+		pthread_cond_wait(&poolDone, &poolMutex);
+	}
+	pthread_mutex_unlock(&poolMutex);
+	pthread_mutex_unlock(&poolOwner);
+}
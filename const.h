@@ -17,6 +17,13 @@
 #define FPS_WINDOW			1
 #define FPS_TERMINAL		2
 
+#define RENDER_DRAWCALLS	0
+#define RENDER_FRAMEBUFFER	1
+#define RENDER_INDEXED		2	// 8-bit palette indices, expanded when presenting
+
+// Packed ARGB8888 colors
+#define COLOR_BLACK			0xFF000000
+
 // Helper functions
 #define	HIDDEN				static
 
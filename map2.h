@@ -1,5 +1,5 @@
-#define WORLD_WIDTH 17
-#define WORLD_HEIGHT 17
+#define WORLD_WIDTH 64
+#define WORLD_HEIGHT 59
 
 int worldMap[WORLD_HEIGHT][WORLD_WIDTH]=
 {